@@ -11,9 +11,6 @@
 #define PIT_PORT_CONTROL          0x43                /* Control port. */
 #define PIT_PORT_COUNTER(CHANNEL) (0x40 + (CHANNEL))  /* Counter port. */
 
-/* PIT cycles per second. */
-#define PIT_HZ 1193180
-
 /* Configure the given CHANNEL in the PIT.  In a PC, the PIT's
    three output channels are hooked up like this:
 
@@ -81,3 +78,46 @@ pit_configure_channel (int channel, int mode, int frequency)
   outb (PIT_PORT_COUNTER (channel), count >> 8);
   intr_set_level (old_level);
 }
+
+/* Starts channel 0 counting down once from COUNT PIT cycles
+   (where 0 means 65536), raising interrupt line 0 when it
+   reaches zero.  This is mode 0 in [8254] terms.  Calling
+   pit_configure_channel() returns the channel to periodic
+   mode. */
+void
+pit_start_one_shot (uint16_t count)
+{
+  enum intr_level old_level;
+
+  old_level = intr_disable ();
+  outb (PIT_PORT_CONTROL, 0x30);
+  outb (PIT_PORT_COUNTER (0), count);
+  outb (PIT_PORT_COUNTER (0), count >> 8);
+  intr_set_level (old_level);
+}
+
+/* Returns the current value of CHANNEL's counter, that is, the
+   number of PIT cycles left in its period or one-shot.  If OUT
+   is nonnull, stores the channel's output level into *OUT; in
+   one-shot mode it is true once the count has run out. */
+uint16_t
+pit_read_count (int channel, bool *out)
+{
+  enum intr_level old_level;
+  uint8_t status, low, high;
+
+  ASSERT (channel == 0 || channel == 2);
+
+  /* Read-back command latching both the status and the count of
+     CHANNEL, which then read back in that order. */
+  old_level = intr_disable ();
+  outb (PIT_PORT_CONTROL, 0xc0 | (2 << channel));
+  status = inb (PIT_PORT_COUNTER (channel));
+  low = inb (PIT_PORT_COUNTER (channel));
+  high = inb (PIT_PORT_COUNTER (channel));
+  intr_set_level (old_level);
+
+  if (out != NULL)
+    *out = (status & 0x80) != 0;
+  return low | (high << 8);
+}
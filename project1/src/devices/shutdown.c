@@ -5,6 +5,7 @@
 #include "devices/serial.h"
 #include "devices/timer.h"
 #include "threads/io.h"
+#include "threads/synch.h"
 #include "threads/thread.h"
 #ifdef USERPROG
 #include "userprog/exception.h"
@@ -120,6 +121,7 @@ print_stats (void)
 {
   timer_print_stats ();
   thread_print_stats ();
+  lock_print_stats ();
 #ifdef FILESYS
   block_print_stats ();
 #endif
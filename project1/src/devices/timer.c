@@ -24,13 +24,55 @@ static int64_t ticks;
    Initialized by timer_calibrate (). */
 static unsigned loops_per_tick;
 
-/* Sorted list of semaphores for threads 
-   put to sleep */
-static struct list wait_semas;
-
-/* A global lock to synchronize insertion 
-   to wait_semas */
-static struct lock wait_semas_lock;
+/* Timer wheel.  A timer due within the next WHEEL1_SIZE ticks
+   sits in wheel1, which has one slot per tick.  One due within
+   the next WHEEL1_SIZE * WHEEL2_SIZE ticks sits in wheel2, which
+   has one slot per WHEEL1_SIZE ticks, and moves down into wheel1
+   when wheel1 wraps around to the start of its slot.  Later
+   timers wait in far_timers, which is redistributed each time
+   wheel2 wraps around.  So adding a timer and running it are
+   both constant time.  Protected by disabling interrupts, which
+   lets the timer interrupt always run every timer that is due. */
+#define WHEEL1_BITS 8
+#define WHEEL1_SIZE (1 << WHEEL1_BITS)
+#define WHEEL2_BITS 6
+#define WHEEL2_SIZE (1 << WHEEL2_BITS)
+static struct list wheel1[WHEEL1_SIZE];
+static struct list wheel2[WHEEL2_SIZE];
+static struct list far_timers;
+
+/* Earliest tick whose timers have not run yet. */
+static int64_t wheel_ticks;
+
+/* PIT cycles per timer tick. */
+#define PIT_TICK_CYCLES ((PIT_HZ + TIMER_FREQ / 2) / TIMER_FREQ)
+
+/* Tickless idle.  While the idle thread halts with no timer due
+   for a few ticks, the PIT runs as a one-shot that interrupts at
+   idle_end_tick instead of at every tick.  idle_end_tick is 0
+   while the PIT runs periodically.  The ticks skipped meanwhile
+   are accounted as idle by the next timer interrupt, or by
+   timer_idle_exit() if another interrupt wakes the CPU first.
+   The last one-shot of a split tick period, below, ends at the
+   next tick the same way, with idle_end_tick set to ticks + 1. */
+static int64_t idle_end_tick;
+
+/* Sub-tick sleeps.  A thread sleeping for less than a tick waits
+   in subtick_sleepers, ordered by deadline in PIT cycles as
+   counted by pit_cycles().  When the earliest deadline falls
+   before the next tick, the current tick period is split: the
+   PIT runs as a one-shot that interrupts at the deadline, and
+   then as another that ends on the tick boundary, whose interrupt
+   restarts the periodic tick.  split_at is the PIT cycle at which
+   the pending split interrupt comes, or 0 if there is none. */
+struct subtick_sleeper
+  {
+    struct list_elem elem;              /* Element in subtick_sleepers. */
+    int64_t deadline;                   /* PIT cycle to wake up at. */
+    struct semaphore sema;              /* Upped to wake up. */
+  };
+static struct list subtick_sleepers;
+static int64_t split_at;
 
 static intr_handler_func timer_interrupt;
 static bool too_many_loops (unsigned loops);
@@ -38,28 +80,31 @@ static void busy_wait (int64_t loops);
 static void real_time_sleep (int64_t num, int32_t denom);
 static void real_time_delay (int64_t num, int32_t denom);
 
-bool tick_compare (const struct list_elem *a,
-		   const struct list_elem *b, void *aux); 
-
-/* Semaphore element for sleeping threads. */
-struct sleep_sema_elem
-  {
-    struct list_elem elem;
-    int wakeup_tick;           /* wake me up when this tick occurs */
-    struct semaphore sema;     /* semaphore to signal the thread to
-				  wake up at wakeup_tick */
-  };
-
+static timer_func wake_sleeper;
+static void wheel_insert (struct timer *);
+static void wheel_cascade (struct list *);
+static void run_timers (void);
+static int wheel_idle_ticks (int max);
+static void skip_idle_ticks (int64_t tick);
+static int64_t pit_cycles (void);
+static void sub_tick_sleep (int64_t num, int32_t denom);
+static void subtick_update (int64_t now);
 
 /* Sets up the timer to interrupt TIMER_FREQ times per second,
    and registers the corresponding interrupt. */
 void
 timer_init (void) 
 {
+  int i;
+
   pit_configure_channel (0, 2, TIMER_FREQ);
   intr_register_ext (0x20, timer_interrupt, "8254 Timer");
-  list_init (&wait_semas);
-  lock_init (&wait_semas_lock);
+  for (i = 0; i < WHEEL1_SIZE; i++)
+    list_init (&wheel1[i]);
+  for (i = 0; i < WHEEL2_SIZE; i++)
+    list_init (&wheel2[i]);
+  list_init (&far_timers);
+  list_init (&subtick_sleepers);
 }
 
 /* Calibrates loops_per_tick, used to implement brief delays. */
@@ -107,36 +152,62 @@ timer_elapsed (int64_t then)
   return timer_ticks () - then;
 }
 
-/* Comparison function for ticks.
-   Returns true is tick value for the first argument is less
-   than the second argument */
-bool 
-tick_compare(const struct list_elem *a,
-	     const struct list_elem *b, void *aux) 
+/* Returns the CPU's time-stamp counter, the number of clock
+   cycles since it was reset.  Much finer grained than
+   timer_ticks(), for timing short events. */
+uint64_t
+timer_cycles (void)
 {
-  ASSERT (aux==NULL);
-  struct sleep_sema_elem *s1 = list_entry (a, struct sleep_sema_elem, elem);
-  struct sleep_sema_elem *s2 = list_entry (b, struct sleep_sema_elem, elem);
-  if (s1->wakeup_tick < s2->wakeup_tick) 
-    return true;
-  return false;
+  uint64_t tsc;
+  asm volatile ("rdtsc" : "=A" (tsc));
+  return tsc;
 }
-                  
+
 /* Sleeps for approximately TICKS timer ticks.  Interrupts must
    be turned on. */
 void
-timer_sleep (int64_t req_ticks) 
+timer_sleep (int64_t ticks) 
 {
-  struct sleep_sema_elem s;
-  s.wakeup_tick = ticks + req_ticks;
-  sema_init (&s.sema,0);
+  struct timer timer;
+  struct semaphore sema;
 
-  lock_acquire (&wait_semas_lock);
-  list_insert_ordered (&wait_semas, &s.elem, tick_compare, NULL);
-  lock_release (&wait_semas_lock);
-
-  sema_down (&s.sema); 
   ASSERT (intr_get_level () == INTR_ON);
+  if (ticks <= 0)
+    return;
+
+  sema_init (&sema, 0);
+  timer_add (&timer, ticks, wake_sleeper, &sema);
+  sema_down (&sema);
+}
+
+/* Timer function for timer_sleep().  Wakes up the thread that
+   is waiting on semaphore SEMA_. */
+static void
+wake_sleeper (void *sema_) 
+{
+  struct semaphore *sema = sema_;
+  sema_up (sema);
+}
+
+/* Arranges for FUNC to be called with AUX as its argument, from
+   the timer interrupt with interrupts off, once TICKS timer ticks
+   from now have passed, or at the next tick if TICKS <= 0.
+   TIMER must stay valid until then.  May be called from an
+   interrupt handler, including from a timer function. */
+void
+timer_add (struct timer *timer, int64_t ticks, timer_func *func, void *aux) 
+{
+  enum intr_level old_level;
+
+  ASSERT (timer != NULL);
+  ASSERT (func != NULL);
+
+  timer->func = func;
+  timer->aux = aux;
+  old_level = intr_disable ();
+  timer->expires = timer_ticks () + ticks;
+  wheel_insert (timer);
+  intr_set_level (old_level);
 }
 
 /* Sleeps for approximately MS milliseconds.  Interrupts must be
@@ -202,6 +273,73 @@ timer_ndelay (int64_t ns)
   real_time_delay (ns, 1000 * 1000 * 1000);
 }
 
+/* Called by the idle thread, with interrupts off, just before it
+   halts the CPU.  If no timer is due within the next few ticks,
+   reprograms the PIT to interrupt only at the tick before which
+   one is, as far ahead as its 16-bit counter reaches. */
+void
+timer_idle_enter (void) 
+{
+  int left, n;
+
+  ASSERT (intr_get_level () == INTR_OFF);
+
+  /* Keep ticking while a one-shot is already running, or while a
+     sub-tick sleeper may need the period split. */
+  if (idle_end_tick != 0 || split_at != 0
+      || !list_empty (&subtick_sleepers))
+    return;
+
+  left = pit_read_count (0, NULL);
+  n = wheel_idle_ticks (1 + (UINT16_MAX - left) / PIT_TICK_CYCLES);
+  if (n < 2)
+    return;
+  pit_start_one_shot (left + (n - 1) * PIT_TICK_CYCLES);
+  idle_end_tick = ticks + n;
+
+  /* If a tick's interrupt was already raised, LEFT was counted
+     from the wrong tick, and the interrupt would be mistaken for
+     the end of the one-shot.  Go back to ticking periodically. */
+  if (intr_pending (0x20))
+    {
+      pit_configure_channel (0, 2, TIMER_FREQ);
+      idle_end_tick = 0;
+    }
+}
+
+/* Called when the scheduler switches away from the idle thread,
+   with interrupts off.  If the one-shot set up by
+   timer_idle_enter() is still counting, some other interrupt
+   woke the CPU early: accounts the ticks that have passed as
+   idle and cuts the one-shot short at the next tick, whose
+   interrupt restarts the periodic tick. */
+void
+timer_idle_exit (void) 
+{
+  bool expired;
+  int left, ticks_left;
+
+  ASSERT (intr_get_level () == INTR_OFF);
+
+  if (idle_end_tick == 0)
+    return;
+  left = pit_read_count (0, &expired);
+  if (expired)
+    {
+      /* Its interrupt is pending and will do the accounting. */
+      return;
+    }
+
+  /* The one-shot ends on a tick boundary and spans whole ticks
+     before that, so the ticks still to come are those whole
+     ticks left in the count. */
+  ticks_left = left / PIT_TICK_CYCLES;
+  skip_idle_ticks (idle_end_tick - 1 - ticks_left);
+  left -= ticks_left * PIT_TICK_CYCLES;
+  pit_start_one_shot (left > 0 ? left : 1);
+  idle_end_tick = ticks + 1;
+}
+
 /* Prints timer statistics. */
 void
 timer_print_stats (void) 
@@ -214,30 +352,159 @@ timer_print_stats (void)
 static void
 timer_interrupt (struct intr_frame *args UNUSED)
 {
+  if (split_at != 0)
+    {
+      /* Not a tick, but a deadline within a split tick period.
+         Unless the period is split again, run out the rest of it
+         as a one-shot. */
+      int64_t now = split_at;
+
+      split_at = 0;
+      subtick_update (now);
+      if (split_at == 0)
+        {
+          pit_start_one_shot ((ticks + 1) * PIT_TICK_CYCLES - now);
+          idle_end_tick = ticks + 1;
+        }
+      return;
+    }
+
+  if (idle_end_tick != 0)
+    {
+      /* End of a tickless idle period. */
+      pit_configure_channel (0, 2, TIMER_FREQ);
+      skip_idle_ticks (idle_end_tick - 1);
+      idle_end_tick = 0;
+    }
+
   ticks++;
   thread_tick ();
+  run_timers ();
+  subtick_update (ticks * PIT_TICK_CYCLES);
+}
+
+/* Adds TIMER to the wheel slot for its expiry tick, or to the
+   slot for the next tick if that has already passed.  Interrupts
+   must be off. */
+static void
+wheel_insert (struct timer *timer) 
+{
+  int64_t delta = timer->expires - wheel_ticks;
+  struct list *slot;
+
+  ASSERT (intr_get_level () == INTR_OFF);
+
+  if (delta < 0)
+    slot = &wheel1[wheel_ticks & (WHEEL1_SIZE - 1)];
+  else if (delta < WHEEL1_SIZE)
+    slot = &wheel1[timer->expires & (WHEEL1_SIZE - 1)];
+  else if (delta < WHEEL1_SIZE * WHEEL2_SIZE)
+    slot = &wheel2[(timer->expires >> WHEEL1_BITS) & (WHEEL2_SIZE - 1)];
+  else
+    slot = &far_timers;
+  list_push_back (slot, &timer->elem);
+}
 
-  if (lock_try_acquire (&wait_semas_lock))
+/* Moves the timers in SLOT into the slots that now match their
+   expiry ticks, which are finer grained as those ticks draw
+   near. */
+static void
+wheel_cascade (struct list *slot) 
+{
+  struct list timers;
+
+  list_init (&timers);
+  list_splice (list_end (&timers), list_begin (slot), list_end (slot));
+  while (!list_empty (&timers))
+    wheel_insert (list_entry (list_pop_front (&timers),
+                              struct timer, elem));
+}
+
+/* Runs every timer that is due by the current tick. */
+static void
+run_timers (void) 
+{
+  while (wheel_ticks <= ticks)
+    {
+      int idx = wheel_ticks & (WHEEL1_SIZE - 1);
+      struct list expired;
+
+      if (idx == 0)
+        {
+          int idx2 = (wheel_ticks >> WHEEL1_BITS) & (WHEEL2_SIZE - 1);
+          if (idx2 == 0)
+            wheel_cascade (&far_timers);
+          wheel_cascade (&wheel2[idx2]);
+        }
+
+      /* Detach the slot before running its timers, which may add
+         new timers, and advance past it so that timers added for
+         this tick go to the next one. */
+      list_init (&expired);
+      list_splice (list_end (&expired), list_begin (&wheel1[idx]),
+                   list_end (&wheel1[idx]));
+      wheel_ticks++;
+      while (!list_empty (&expired))
+        {
+          struct timer *timer = list_entry (list_pop_front (&expired),
+                                            struct timer, elem);
+          timer->func (timer->aux);
+        }
+    }
+}
+
+/* Returns the number of ticks from now until the next one at
+   which a timer may be due, at most MAX.  The tick at which
+   wheel1 wraps around counts as due, because timers cascade down
+   from wheel2 then. */
+static int
+wheel_idle_ticks (int max) 
+{
+  int n;
+
+  for (n = 1; n < max; n++)
+    {
+      int idx = (ticks + n) & (WHEEL1_SIZE - 1);
+      if (idx == 0 || !list_empty (&wheel1[idx]))
+        break;
+    }
+  return n;
+}
+
+/* Advances the tick count to TICK, accounting each tick passed as
+   spent idle, for a tickless idle period. */
+static void
+skip_idle_ticks (int64_t tick) 
+{
+  while (ticks < tick)
     {
-      struct list_elem *e = list_begin (&wait_semas);
-      while (e != list_end (&wait_semas)) 
-	{
-	  struct sleep_sema_elem* s = list_entry (e,struct sleep_sema_elem, elem);
-	  if (s->wakeup_tick <= ticks) 
-	    {  
-	      e = list_remove (e);
-	      sema_up (&s->sema);
-	    } 
-	  else 
-	    { 
-	      /* ordered list, so rest of elements are also not expired */
-	      break;
-	    } 
-	}
-      lock_release (&wait_semas_lock);
+      ticks++;
+      thread_idle_tick ();
     }
 }
 
+/* Returns the number of PIT cycles since the OS booted, which
+   is much finer grained than timer_ticks().  Outside a tickless
+   idle period, the PIT's count runs down to the next tick, or to
+   split_at in a split tick period. */
+static int64_t
+pit_cycles (void) 
+{
+  enum intr_level old_level = intr_disable ();
+  bool out;
+  int left = pit_read_count (0, &out);
+  int64_t next = split_at != 0 ? split_at : (ticks + 1) * PIT_TICK_CYCLES;
+  int64_t t;
+
+  /* A one-shot that ran out keeps counting down from 0xffff. */
+  if (out && (split_at != 0 || idle_end_tick != 0))
+    t = next;
+  else
+    t = next - left;
+  intr_set_level (old_level);
+  return t;
+}
+
 /* Returns true if LOOPS iterations waits for more than one timer
    tick, otherwise false. */
 static bool
@@ -293,9 +560,77 @@ real_time_sleep (int64_t num, int32_t denom)
     }
   else 
     {
-      /* Otherwise, use a busy-wait loop for more accurate
-         sub-tick timing. */
-      real_time_delay (num, denom); 
+      /* Otherwise, sleep until an interrupt from the PIT in the
+         middle of the tick, for more accurate sub-tick timing. */
+      sub_tick_sleep (num, denom); 
+    }
+}
+
+/* Returns true if sub-tick sleeper A's deadline is before B's. */
+static bool
+subtick_less (const struct list_elem *a_, const struct list_elem *b_,
+              void *aux UNUSED) 
+{
+  const struct subtick_sleeper *a = list_entry (a_, struct subtick_sleeper,
+                                                elem);
+  const struct subtick_sleeper *b = list_entry (b_, struct subtick_sleeper,
+                                                elem);
+  return a->deadline < b->deadline;
+}
+
+/* Sleeps for NUM/DENOM seconds, less than one timer tick, with
+   the thread blocked until a timer interrupt at the deadline
+   wakes it up. */
+static void
+sub_tick_sleep (int64_t num, int32_t denom) 
+{
+  struct subtick_sleeper s;
+  enum intr_level old_level;
+
+  /* With interrupts on, so that a tick whose interrupt is due has
+     been counted. */
+  s.deadline = pit_cycles () + num * PIT_HZ / denom;
+
+  sema_init (&s.sema, 0);
+  old_level = intr_disable ();
+  list_insert_ordered (&subtick_sleepers, &s.elem, subtick_less, NULL);
+  subtick_update (pit_cycles ());
+  intr_set_level (old_level);
+  sema_down (&s.sema);
+}
+
+/* Wakes up the sub-tick sleepers whose deadlines have passed by
+   PIT cycle NOW.  Then, if the PIT is ticking periodically and
+   the next deadline comes before the next tick, splits the
+   current tick period at that deadline.  If a tick's interrupt
+   is already pending, leaves the split to its handler instead,
+   as NOW may be a tick behind.  Interrupts must be off. */
+static void
+subtick_update (int64_t now) 
+{
+  struct subtick_sleeper *s;
+
+  ASSERT (intr_get_level () == INTR_OFF);
+
+  while (!list_empty (&subtick_sleepers))
+    {
+      s = list_entry (list_front (&subtick_sleepers),
+                      struct subtick_sleeper, elem);
+      if (s->deadline > now)
+        break;
+      list_pop_front (&subtick_sleepers);
+      sema_up (&s->sema);
+    }
+
+  if (list_empty (&subtick_sleepers) || split_at != 0 || idle_end_tick != 0
+      || intr_pending (0x20))
+    return;
+  s = list_entry (list_front (&subtick_sleepers),
+                  struct subtick_sleeper, elem);
+  if (s->deadline < (ticks + 1) * PIT_TICK_CYCLES)
+    {
+      pit_start_one_shot (s->deadline - now);
+      split_at = s->deadline;
     }
 }
 
@@ -0,0 +1,82 @@
+/* Checks an adaptive lock.  A thread that finds the lock held by
+   a thread that is ready to run yields directly to the holder
+   instead of blocking, at most 4 times, and blocks after that.
+   A thread that finds the holder blocked blocks at once.  The
+   lock's own statistics show which of these happened. */
+
+#include <stdio.h>
+#include "tests/threads/tests.h"
+#include "threads/init.h"
+#include "threads/synch.h"
+#include "threads/thread.h"
+#include "devices/timer.h"
+
+static thread_func acquire_thread_func;
+static thread_func sleep_acquire_thread_func;
+static void print_stats (const char *, const struct lock *);
+
+void
+test_lock_adaptive (void) 
+{
+  struct lock lock;
+
+  /* This test does not work with the MLFQS. */
+  ASSERT (!thread_mlfqs);
+
+  /* Make sure our priority is the default. */
+  ASSERT (thread_get_priority () == PRI_DEFAULT);
+
+  /* acquire1 preempts us while we hold the lock, yields back to
+     us, and takes the lock once we release it. */
+  lock_init_adaptive (&lock);
+  lock_acquire (&lock);
+  thread_create ("acquire1", PRI_DEFAULT + 1, acquire_thread_func, &lock);
+  msg ("main: still holding the lock.");
+  lock_release (&lock);
+  print_stats ("Holder ready", &lock);
+
+  /* acquire2 wakes up while we sleep holding the lock, so it has
+     no one to yield to. */
+  lock_init_adaptive (&lock);
+  thread_create ("acquire2", PRI_DEFAULT + 1, sleep_acquire_thread_func,
+                 &lock);
+  lock_acquire (&lock);
+  timer_sleep (10);
+  lock_release (&lock);
+  print_stats ("Holder asleep", &lock);
+
+  /* We keep yielding with the lock held until acquire3 gives up
+     yielding back to us and blocks. */
+  lock_init_adaptive (&lock);
+  lock_acquire (&lock);
+  thread_create ("acquire3", PRI_DEFAULT + 1, acquire_thread_func, &lock);
+  while (lock.block_cnt == 0)
+    thread_yield ();
+  lock_release (&lock);
+  print_stats ("Holder kept the lock", &lock);
+}
+
+static void
+acquire_thread_func (void *lock_) 
+{
+  struct lock *lock = lock_;
+
+  lock_acquire (lock);
+  msg ("%s: got the lock", thread_name ());
+  lock_release (lock);
+  msg ("%s: done", thread_name ());
+}
+
+static void
+sleep_acquire_thread_func (void *lock_) 
+{
+  timer_sleep (5);
+  acquire_thread_func (lock_);
+}
+
+static void
+print_stats (const char *what, const struct lock *lock) 
+{
+  msg ("%s: %u contended, %u directed yields, %u blocked.",
+       what, lock->contended_cnt, lock->yield_cnt, lock->block_cnt);
+}
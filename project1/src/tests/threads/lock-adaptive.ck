@@ -0,0 +1,19 @@
+# -*- perl -*-
+use strict;
+use warnings;
+use tests::tests;
+check_expected ([<<'EOF']);
+(lock-adaptive) begin
+(lock-adaptive) main: still holding the lock.
+(lock-adaptive) acquire1: got the lock
+(lock-adaptive) acquire1: done
+(lock-adaptive) Holder ready: 1 contended, 1 directed yields, 0 blocked.
+(lock-adaptive) acquire2: got the lock
+(lock-adaptive) acquire2: done
+(lock-adaptive) Holder asleep: 1 contended, 0 directed yields, 1 blocked.
+(lock-adaptive) acquire3: got the lock
+(lock-adaptive) acquire3: done
+(lock-adaptive) Holder kept the lock: 1 contended, 4 directed yields, 1 blocked.
+(lock-adaptive) end
+EOF
+pass;
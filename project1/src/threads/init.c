@@ -19,6 +19,7 @@
 #include "threads/io.h"
 #include "threads/loader.h"
 #include "threads/malloc.h"
+#include "threads/mp.h"
 #include "threads/palloc.h"
 #include "threads/pte.h"
 #include "threads/thread.h"
@@ -98,6 +99,7 @@ main (void)
   palloc_init (user_page_limit);
   malloc_init ();
   paging_init ();
+  mp_init ();
 
   /* Segmentation. */
 #ifdef USERPROG
@@ -225,6 +225,34 @@ intr_yield_on_return (void)
   yield_on_return = true;
 }
 
+/* Returns true if external interrupt VEC_NO has been raised
+   but not yet delivered, for example because interrupts are
+   off. */
+bool
+intr_pending (uint8_t vec_no) 
+{
+  enum intr_level old_level;
+  uint8_t irr;
+
+  ASSERT (vec_no >= 0x20 && vec_no <= 0x2f);
+
+  /* OCW3: read the Interrupt Request Register. */
+  old_level = intr_disable ();
+  if (vec_no < 0x28)
+    {
+      outb (PIC0_CTRL, 0x0a);
+      irr = inb (PIC0_CTRL);
+    }
+  else
+    {
+      outb (PIC1_CTRL, 0x0a);
+      irr = inb (PIC1_CTRL);
+    }
+  intr_set_level (old_level);
+
+  return (irr & (1 << (vec_no & 7))) != 0;
+}
+
 /* 8259A Programmable Interrupt Controller. */
 
 /* Initializes the PICs.  Refer to [8259A] for details.
@@ -384,7 +412,7 @@ intr_handler (struct intr_frame *frame)
       pic_end_of_interrupt (frame->vec_no); 
 
       if (yield_on_return) 
-        thread_yield (); 
+        thread_preempt (); 
     }
 }
 
@@ -0,0 +1,228 @@
+#include "threads/mp.h"
+#include <debug.h>
+#include <inttypes.h>
+#include <packed.h>
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdio.h>
+#include <string.h>
+#include "threads/loader.h"
+#include "threads/vaddr.h"
+
+/* Multiprocessor configuration, as described by the BIOS in the
+   tables of the Intel MultiProcessor Specification, version
+   1.4.
+
+   Only the boot processor runs Pintos.  The application
+   processors found here stay halted, as the BIOS left them;
+   starting them would take a real-mode trampoline, a mapping of
+   the local APIC and per-CPU stacks, GDTs, TSSs and run queues.
+   This records what there is to start. */
+
+/* MP floating pointer structure. */
+struct mp_float
+  {
+    char signature[4];          /* "_MP_". */
+    uint32_t config;            /* Physical address of mp_config. */
+    uint8_t length;             /* Length in 16-byte units. */
+    uint8_t spec_rev;           /* Specification revision. */
+    uint8_t checksum;           /* All bytes sum to 0. */
+    uint8_t default_config;     /* Nonzero: default config, no table. */
+    uint8_t features[4];
+  } PACKED;
+
+/* MP configuration table header. */
+struct mp_config
+  {
+    char signature[4];          /* "PCMP". */
+    uint16_t length;            /* Base table length in bytes. */
+    uint8_t spec_rev;           /* Specification revision. */
+    uint8_t checksum;           /* All bytes sum to 0. */
+    char oem_id[8];
+    char product_id[12];
+    uint32_t oem_table;
+    uint16_t oem_table_size;
+    uint16_t entry_cnt;         /* Number of entries that follow. */
+    uint32_t lapic_addr;        /* Physical address of local APICs. */
+    uint16_t ext_length;
+    uint8_t ext_checksum;
+    uint8_t reserved;
+  } PACKED;
+
+/* Processor entry in the configuration table. */
+struct mp_processor
+  {
+    uint8_t type;               /* MP_PROCESSOR. */
+    uint8_t lapic_id;           /* Local APIC ID. */
+    uint8_t lapic_version;
+    uint8_t flags;              /* MP_CPU_* flags. */
+    uint32_t signature;
+    uint32_t features;
+    uint32_t reserved[2];
+  } PACKED;
+
+#define MP_PROCESSOR 0          /* Processor entry type. */
+#define MP_CPU_ENABLED 0x01     /* Processor is usable. */
+#define MP_CPU_BSP 0x02         /* Processor is the boot processor. */
+
+/* Configuration found by mp_init(). */
+static int cpu_cnt = 1;
+static uint8_t lapic_ids[MP_MAX_CPUS];
+static uint32_t lapic_addr;
+
+/* Returns the sum of the SIZE bytes at P. */
+static uint8_t
+sum_bytes (const void *p, size_t size) 
+{
+  const uint8_t *bytes = p;
+  uint8_t sum = 0;
+
+  while (size-- > 0)
+    sum += *bytes++;
+  return sum;
+}
+
+/* Returns true if the SIZE bytes of physical memory at PADDR
+   lie within the RAM that paging_init() mapped at PHYS_BASE, so
+   that ptov() may be applied to them. */
+static bool
+is_mapped (uintptr_t paddr, size_t size) 
+{
+  uintptr_t limit = (uintptr_t) init_ram_pages * PGSIZE;
+
+  return paddr < limit && size <= limit - paddr;
+}
+
+/* Looks for an MP floating pointer structure in the SIZE bytes
+   of physical memory starting at PADDR.  Returns it if found,
+   otherwise a null pointer. */
+static struct mp_float *
+find_float (uintptr_t paddr, size_t size) 
+{
+  uint8_t *p, *end;
+
+  if (!is_mapped (paddr, size))
+    return NULL;
+  p = ptov (paddr);
+  end = p + size;
+
+  for (; p + sizeof (struct mp_float) <= end; p += 16)
+    if (!memcmp (p, "_MP_", 4)
+        && sum_bytes (p, sizeof (struct mp_float)) == 0)
+      return (struct mp_float *) p;
+  return NULL;
+}
+
+/* Searches, in order, the first kilobyte of the Extended BIOS
+   Data Area, the last kilobyte of base memory and the BIOS ROM
+   for the MP floating pointer structure, as the specification
+   prescribes. */
+static struct mp_float *
+search_float (void) 
+{
+  uintptr_t ebda = *(uint16_t *) ptov (0x40e) << 4;
+  uintptr_t base_kb = *(uint16_t *) ptov (0x413);
+  struct mp_float *mpf = NULL;
+
+  if (ebda != 0)
+    mpf = find_float (ebda, 1024);
+  if (mpf == NULL && base_kb != 0)
+    mpf = find_float (base_kb * 1024 - 1024, 1024);
+  if (mpf == NULL)
+    mpf = find_float (0xf0000, 0x10000);
+  return mpf;
+}
+
+/* Reads the processors out of the BIOS's MP configuration
+   table and reports them.  Must be called after paging_init(),
+   since the table may lie anywhere in RAM. */
+void
+mp_init (void) 
+{
+  struct mp_float *mpf = search_float ();
+  struct mp_config *conf;
+  uint8_t *entry;
+  int i;
+
+  if (mpf == NULL)
+    return;
+  if (mpf->default_config != 0 || mpf->config == 0)
+    {
+      /* Default configurations all have two processors. */
+      cpu_cnt = 2;
+      lapic_ids[0] = 0;
+      lapic_ids[1] = 1;
+      lapic_addr = 0xfee00000;
+      printf ("MP: default configuration %d, 2 CPUs.\n",
+              mpf->default_config);
+      return;
+    }
+
+  if (!is_mapped (mpf->config, sizeof *conf))
+    {
+      printf ("MP: configuration table at %#"PRIx32" is not in RAM, "
+              "assuming 1 CPU.\n", mpf->config);
+      return;
+    }
+  conf = ptov (mpf->config);
+  if (memcmp (conf->signature, "PCMP", 4)
+      || !is_mapped (mpf->config, conf->length)
+      || sum_bytes (conf, conf->length) != 0)
+    {
+      printf ("MP: bad configuration table, assuming 1 CPU.\n");
+      return;
+    }
+
+  cpu_cnt = 0;
+  lapic_addr = conf->lapic_addr;
+  entry = (uint8_t *) (conf + 1);
+  for (i = 0; i < conf->entry_cnt; i++)
+    {
+      if (*entry == MP_PROCESSOR)
+        {
+          struct mp_processor *proc = (struct mp_processor *) entry;
+          if ((proc->flags & MP_CPU_ENABLED) && cpu_cnt < MP_MAX_CPUS)
+            {
+              /* Keep the boot processor first. */
+              if (proc->flags & MP_CPU_BSP)
+                {
+                  lapic_ids[cpu_cnt] = lapic_ids[0];
+                  lapic_ids[0] = proc->lapic_id;
+                }
+              else
+                lapic_ids[cpu_cnt] = proc->lapic_id;
+              cpu_cnt++;
+            }
+          entry += sizeof (struct mp_processor);
+        }
+      else
+        {
+          /* All other entry types are 8 bytes long. */
+          entry += 8;
+        }
+    }
+  if (cpu_cnt == 0)
+    cpu_cnt = 1;
+
+  printf ("MP: %d CPU%s, local APIC at %#"PRIx32", boot APIC ID %d",
+          cpu_cnt, cpu_cnt > 1 ? "s" : "", lapic_addr, lapic_ids[0]);
+  if (cpu_cnt > 1)
+    printf ("; running on the boot CPU only");
+  printf (".\n");
+}
+
+/* Returns the number of usable processors, including the boot
+   processor. */
+int
+mp_cpu_cnt (void) 
+{
+  return cpu_cnt;
+}
+
+/* Returns the physical address of the local APICs, or 0 if the
+   BIOS did not describe one. */
+uint32_t
+mp_lapic_addr (void) 
+{
+  return lapic_addr;
+}
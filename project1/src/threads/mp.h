@@ -0,0 +1,13 @@
+#ifndef THREADS_MP_H
+#define THREADS_MP_H
+
+#include <stdint.h>
+
+/* Most processors recorded from the MP configuration table. */
+#define MP_MAX_CPUS 16
+
+void mp_init (void);
+int mp_cpu_cnt (void);
+uint32_t mp_lapic_addr (void);
+
+#endif /* threads/mp.h */
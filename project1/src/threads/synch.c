@@ -36,8 +36,21 @@
 bool sema_priority_compare (const struct list_elem *a, 
 			    const struct list_elem *b, void *aux);
 
-/* function that handles donation of priorities */
-void lock_propagate_donation (struct lock *lock);
+/* functions that handle donation of priorities */
+static void lock_donate (struct lock *lock, int priority);
+static void lock_take (struct lock *lock);
+static bool lock_priority_compare (const struct list_elem *a,
+				   const struct list_elem *b, void *aux);
+static void lock_yield_to_holder (struct lock *lock);
+
+/* Most times an adaptive lock's acquirer yields to the holder
+   before blocking. */
+#define ADAPTIVE_YIELD_MAX 4
+
+/* Contention statistics, totalled over all locks. */
+static unsigned long long lock_contended_cnt;
+static unsigned long long lock_yield_cnt;
+static unsigned long long lock_block_cnt;
 
 /* Initializes semaphore SEMA to VALUE.  A semaphore is a
    nonnegative integer along with two atomic operators for
@@ -75,8 +88,10 @@ sema_down (struct semaphore *sema)
   old_level = intr_disable ();
   while (sema->value == 0) 
     {
-      list_insert_ordered (&sema->waiters, &thread_current ()->elem,
+      struct thread *cur = thread_current ();
+      list_insert_ordered (&sema->waiters, &cur->elem,
                           priority_compare, NULL);
+      cur->waiting_sema = sema;
       thread_block ();
     }
   sema->value--;
@@ -127,12 +142,16 @@ sema_up (struct semaphore *sema)
      positive */
   sema->value++;
 
-  /* Sort before popping the first waiter */
-  list_sort (&sema->waiters, priority_compare, NULL);
-
+  /* Waiters stay in priority order even when donation changes
+     their priorities (see thread_set_effective_priority()), so
+     the front one has the highest priority */
   if (!list_empty (&sema->waiters)) 
-    thread_unblock (list_entry (list_pop_front (&sema->waiters),
-                                struct thread, elem));
+    {
+      struct thread *t = list_entry (list_pop_front (&sema->waiters),
+                                     struct thread, elem);
+      t->waiting_sema = NULL;
+      thread_unblock (t);
+    }
   intr_set_level (old_level);
 }
 
@@ -194,38 +213,95 @@ lock_init (struct lock *lock)
   ASSERT (lock != NULL);
 
   lock->holder = NULL;
+  lock->priority = PRI_MIN;
+  lock->adaptive = false;
+  lock->contended_cnt = lock->yield_cnt = lock->block_cnt = 0;
   sema_init (&lock->semaphore, 1);
-  sema_init (&lock->acquire_semaphore, 1);
 }
 
-/* Propagates donation of priority from the current thread
-   to the holder of the lock that is blocking the current 
-   thread. Recursively propagates donation of priority down 
-   the chain in case of nested blocking. */
+/* Initializes LOCK as an adaptive lock.  An acquirer that finds
+   an adaptive lock held by a thread that is ready to run, that
+   is, one preempted inside its critical section, first yields
+   the CPU directly to that thread, a few times at most, instead
+   of blocking right away.  This suits locks held only for short
+   critical sections, which the holder then likely finishes
+   within the time slice it is handed. */
 void
-lock_propagate_donation (struct lock *lock) 
+lock_init_adaptive (struct lock *lock)
 {
-  if (lock->holder != NULL) 
-    {      
-      /* if my priority is higher than lock holder's priority, donate */
-      struct thread *curr = thread_current ();
-      if (curr->priority > lock->holder->priority)
-	lock->holder->priority = curr->priority;
-      curr->blocking_lock = lock;
-      struct thread *next_thread = lock->holder;
-
-      while (next_thread->blocking_lock) 
-        {
-	  struct thread *h = next_thread->blocking_lock->holder;
-	  if (next_thread->priority > h->priority) 
-	    {
-	      h->priority = next_thread->priority;
-	      next_thread = next_thread->blocking_lock->holder;
-	    }
-	}
+  lock_init (lock);
+  lock->adaptive = true;
+}
+
+/* For adaptive LOCK, yields the CPU straight to LOCK's holder
+   for as long as the holder is ready to run, up to
+   ADAPTIVE_YIELD_MAX times.  Interrupts must be off. */
+static void
+lock_yield_to_holder (struct lock *lock) 
+{
+  int i;
+
+  ASSERT (intr_get_level () == INTR_OFF);
+
+  for (i = 0; i < ADAPTIVE_YIELD_MAX; i++) 
+    {
+      if (lock->holder == NULL || lock->holder->status != THREAD_READY)
+	break;
+      lock->yield_cnt++;
+      lock_yield_cnt++;
+      thread_yield_to (lock->holder);
+    }
+}
+
+/* Donates PRIORITY, that of a thread now waiting for LOCK, to
+   LOCK's holder, and on through the chain of locks that each
+   holder is itself waiting for, as far as that raises anyone's
+   priority.  Each lock's place among its holder's acquired_locks
+   is kept up to date, so that a holder's priority is always the
+   larger of its own and that of its first acquired lock.
+   Interrupts must be off. */
+static void
+lock_donate (struct lock *lock, int priority) 
+{
+  ASSERT (intr_get_level () == INTR_OFF);
+
+  while (lock != NULL && lock->holder != NULL
+	 && lock->priority < priority) 
+    {
+      struct thread *holder = lock->holder;
+
+      lock->priority = priority;
+      list_remove (&lock->elem);
+      list_insert_ordered (&holder->acquired_locks, &lock->elem,
+			   lock_priority_compare, NULL);
+      if (holder->priority >= priority)
+	break;
+      thread_set_effective_priority (holder, priority);
+      lock = holder->blocking_lock;
     }
 }
 
+/* Makes the current thread the holder of LOCK, which it has just
+   downed the semaphore of.  Interrupts must be off. */
+static void
+lock_take (struct lock *lock) 
+{
+  struct thread *curr = thread_current ();
+  struct list *waiters = &lock->semaphore.waiters;
+
+  ASSERT (intr_get_level () == INTR_OFF);
+
+  lock->holder = curr;
+  lock->priority = PRI_MIN;
+  if (!list_empty (waiters))
+    lock->priority = list_entry (list_front (waiters),
+				 struct thread, elem)->priority;
+  list_insert_ordered (&curr->acquired_locks, &lock->elem,
+		       lock_priority_compare, NULL);
+  if (lock->priority > curr->priority)
+    thread_set_effective_priority (curr, lock->priority);
+}
+
 /* Acquires LOCK, sleeping until it becomes available if
    necessary.  The lock must not already be held by the current
    thread.
@@ -237,21 +313,32 @@ lock_propagate_donation (struct lock *lock)
 void
 lock_acquire (struct lock *lock)
 {
+  struct thread *curr = thread_current ();
+  enum intr_level old_level;
+
   ASSERT (lock != NULL);
   ASSERT (!intr_context ());
   ASSERT (!lock_held_by_current_thread (lock));
- 
-  sema_down (&lock->acquire_semaphore);
-  lock_propagate_donation (lock);
-  sema_up (&lock->acquire_semaphore);
-  
-  sema_down (&lock->semaphore);
-  thread_current ()->blocking_lock = NULL;
-  struct thread* curr = thread_current ();
-  lock->holder = curr;
 
-  /* keep a list of locks we've acquired... */
-  list_push_back (&curr->acquired_locks, &lock->elem);
+  old_level = intr_disable ();
+  if (lock->holder != NULL)
+    {
+      lock->contended_cnt++;
+      lock_contended_cnt++;
+      if (lock->adaptive)
+	lock_yield_to_holder (lock);
+    }
+  if (lock->holder != NULL)
+    {
+      lock->block_cnt++;
+      lock_block_cnt++;
+      curr->blocking_lock = lock;
+      lock_donate (lock, curr->priority);
+    }
+  sema_down (&lock->semaphore);
+  curr->blocking_lock = NULL;
+  lock_take (lock);
+  intr_set_level (old_level);
 }
 
 /* Tries to acquires LOCK and returns true if successful or false
@@ -263,18 +350,16 @@ lock_acquire (struct lock *lock)
 bool
 lock_try_acquire (struct lock *lock)
 {
+  enum intr_level old_level;
   bool success;
 
   ASSERT (lock != NULL);
 
+  old_level = intr_disable ();
   success = sema_try_down (&lock->semaphore);
   if (success) 
-    {
-      struct thread* curr = thread_current ();
-      lock->holder = curr;
-      /* keep a list of locks we've acquired... */
-      list_push_back (&curr->acquired_locks, &lock->elem);
-    }
+    lock_take (lock);
+  intr_set_level (old_level);
   return success;
 }
 
@@ -286,38 +371,36 @@ lock_try_acquire (struct lock *lock)
 void
 lock_release (struct lock *lock) 
 {
+  struct thread *curr = thread_current ();
+  enum intr_level old_level;
+  int priority;
+
   ASSERT (lock != NULL);
   ASSERT (lock_held_by_current_thread (lock));
 
+  /* give up the priority donated through LOCK.  The rest, if
+     any, comes through the first of the locks still held. */
+  old_level = intr_disable ();
   lock->holder = NULL;
-
-  /* give up any donated priorities by going through locks i still
-     have acquired and set it to those */
-  struct thread *curr = thread_current();
-  
-  /* remove from acquired_locks list */
   list_remove (&lock->elem);
-
-  /* find max donated priority */
-  int max_donated_priority = curr->orig_priority;
-  struct list_elem *e;
-  for (e = list_begin (&curr->acquired_locks); 
-       e != list_end (&curr->acquired_locks); 
-       e = list_next (e)) 
+  priority = curr->orig_priority;
+  if (!list_empty (&curr->acquired_locks))
     {
-      struct lock *l = list_entry (e, struct lock, elem);
-      if (list_empty (&l->semaphore.waiters)) 
-	continue;
-      struct thread *donor_thread = list_entry (list_front (&l->semaphore.waiters),
-						struct thread, elem);
-      if(donor_thread->priority > max_donated_priority) 
-	{
-	  max_donated_priority = donor_thread->priority;
-	}
+      struct lock *l = list_entry (list_front (&curr->acquired_locks),
+				   struct lock, elem);
+      if (l->priority > priority)
+	priority = l->priority;
     }
-  curr->priority = max_donated_priority;
+  thread_set_effective_priority (curr, priority);
 
   sema_up (&lock->semaphore);
+  intr_set_level (old_level);
+
+  /* A thread that yielded to us for an adaptive lock is ready
+     rather than blocked, so the sema_up() above did not wake it,
+     however high its priority. */
+  if (lock->adaptive)
+    thread_yield ();
 }
 
 /* Returns true if the current thread holds LOCK, false
@@ -331,6 +414,15 @@ lock_held_by_current_thread (const struct lock *lock)
   return lock->holder == thread_current ();
 }
 
+/* Prints lock contention statistics. */
+void
+lock_print_stats (void) 
+{
+  printf ("Locks: %llu contended acquires, %llu directed yields, "
+	  "%llu blocked\n",
+	  lock_contended_cnt, lock_yield_cnt, lock_block_cnt);
+}
+
 /* One semaphore in a list. */
 struct semaphore_elem 
   {
@@ -380,12 +472,12 @@ cond_wait (struct condition *cond, struct lock *lock)
   ASSERT (lock_held_by_current_thread (lock));
   
   sema_init (&waiter.semaphore, 0);
-  /* Inserts semaphore_elem (thread) that share a condition variable
-     in order of thread priority */
+  /* Waiters are queued in arrival order; cond_signal() picks the
+     one with the highest priority at signal time, which donation
+     may have raised since it started waiting */
   lock_release (lock);
   waiter.t = thread_current();
-  list_insert_ordered (&cond->waiters, &waiter.elem,
-		       sema_priority_compare, NULL);
+  list_push_back (&cond->waiters, &waiter.elem);
   sema_down (&waiter.semaphore);
   lock_acquire (lock);
 }
@@ -407,8 +499,12 @@ cond_signal (struct condition *cond, struct lock *lock UNUSED)
 
   if (!list_empty (&cond->waiters)) 
     {
-      sema_up (&list_entry (list_pop_front (&cond->waiters),
-			    struct semaphore_elem, elem)->semaphore);
+      /* sema_priority_compare orders by descending priority, so
+	 the "minimum" is the first waiter of highest priority */
+      struct list_elem *e = list_min (&cond->waiters,
+				      sema_priority_compare, NULL);
+      list_remove (e);
+      sema_up (&list_entry (e, struct semaphore_elem, elem)->semaphore);
     }
 }
 
@@ -447,3 +543,14 @@ sema_priority_compare (const struct list_elem *a,
     return true;
   return false;
 }
+
+/* comparison function for the priorities donated through locks */
+static bool 
+lock_priority_compare (const struct list_elem *a, 
+		       const struct list_elem *b, void *aux UNUSED) 
+{
+  const struct lock *l1 = list_entry (a, struct lock, elem);
+  const struct lock *l2 = list_entry (b, struct lock, elem);
+
+  return l1->priority > l2->priority;
+}
@@ -23,15 +23,22 @@ struct lock
     struct thread *holder;      /* Thread holding lock (for debugging). */
     struct semaphore semaphore; /* Binary semaphore controlling access. */
     struct list_elem elem;      /* List elem. */
-    struct semaphore acquire_semaphore; /* Semaphore for controlling
-					   acquire */
+    int priority;               /* Highest priority of a waiter. */
+    bool adaptive;              /* Yield to a ready holder first? */
+
+    /* Contention statistics, also totalled by lock_print_stats(). */
+    unsigned contended_cnt;     /* # of acquires that found it held. */
+    unsigned yield_cnt;         /* # of directed yields to holder. */
+    unsigned block_cnt;         /* # of acquires that had to block. */
   };
 
 void lock_init (struct lock *);
+void lock_init_adaptive (struct lock *);
 void lock_acquire (struct lock *);
 bool lock_try_acquire (struct lock *);
 void lock_release (struct lock *);
 bool lock_held_by_current_thread (const struct lock *);
+void lock_print_stats (void);
 
 /* Condition variable. */
 struct condition 
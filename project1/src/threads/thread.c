@@ -24,9 +24,15 @@
    of thread.h for details. */
 #define THREAD_MAGIC 0xcd6abf4b
 
-/* List of processes in THREAD_READY state, that is, processes
-   that are ready to run but not actually running. */
-static struct list ready_list;
+/* Processes in THREAD_READY state, that is, processes that are
+   ready to run but not actually running.  There is one FIFO queue
+   per priority, used by both the priority and the MLFQS
+   scheduler, and bit P of ready_mask is set whenever
+   ready_queues[P] is non-empty, so the highest-priority ready
+   thread is found in constant time. */
+static struct list ready_queues[PRI_MAX + 1];
+static uint64_t ready_mask;
+static int ready_cnt;           /* # of threads in ready_queues. */
 
 /* List of all processes.  Processes are added to this list
    when they are first scheduled and removed when they exit. */
@@ -58,16 +64,34 @@ static long long user_ticks;    /* # of timer ticks in user programs. */
 #define TIME_SLICE 4            /* # of timer ticks to give each thread. */
 static unsigned thread_ticks;   /* # of timer ticks since last yield. */
 
+/* Run-queue latency, the time from becoming ready to running,
+   counted by log2 of time-stamp counter cycles. */
+#define LATENCY_BUCKETS 48
+static unsigned long long latency_hist[LATENCY_BUCKETS];
+
+/* Statistics of threads that have exited, totalled. */
+static unsigned exited_cnt;
+static unsigned long long exited_run_cycles, exited_wait_cycles;
+static unsigned long long exited_voluntary_cnt, exited_involuntary_cnt;
+
+/* True while thread_preempt() switches threads, so that
+   schedule() counts the switch as involuntary. */
+static bool preempting;
+
 /* If false (default), use round-robin scheduler.
    If true, use multi-level feedback queue scheduler.
    Controlled by kernel command-line option "-o mlfqs". */
 bool thread_mlfqs;
 
+/* Thread that thread_yield_to() picked to run next, if any. */
+static struct thread *yield_target;
+
 /* System-wide load average for MLFQS */
 static int mlfqs_load_avg;
 
-/* Ready list (Queue) for each priority */
-static struct list mlfqs_ready_list[PRI_MAX+1];
+/* Threads whose recent_cpu grew since priorities were last
+   recalculated, and whose priorities are therefore stale. */
+static struct list mlfqs_ran_list;
 
 static void kernel_thread (thread_func *, void *aux);
 
@@ -80,15 +104,16 @@ static void *alloc_frame (struct thread *, size_t size);
 static void schedule (void);
 void thread_schedule_tail (struct thread *prev);
 static tid_t allocate_tid (void);
+static void account_tick (struct thread *);
+static void ready_queue_push (struct thread *);
+static void ready_queue_remove (struct thread *);
+static struct thread *ready_queue_pop (void);
 
 /* MLFQS functions */
 void mlfqs_update_recent_cpu (struct thread *t, void *aux);
 void mlfqs_update_priority (struct thread *t, void *aux);
 int mlfqs_calc_priority (const struct thread *t);
 int mlfqs_calc_load_average (const struct thread *t);
-int mlfqs_list_size (void);
-void mlfqs_reorder_list (void);
-bool mlfqs_list_empty (void);
 
 /* Initializes the threading system by transforming the code
    that's currently running into a thread.  This can't work in
@@ -106,28 +131,24 @@ bool mlfqs_list_empty (void);
 void
 thread_init (void) 
 {
+  int i;
+
   ASSERT (intr_get_level () == INTR_OFF);
 
   lock_init (&tid_lock);
-  if (!thread_mlfqs) 
-    { 
-      list_init (&ready_list); 
-    } 
-  else 
-    { 
-      int i = 0;
-      for (i = 0; i <= PRI_MAX; i++) 
-	{
-	  list_init (&mlfqs_ready_list[i]);
-	}
-    }
+  for (i = 0; i <= PRI_MAX; i++) 
+    list_init (&ready_queues[i]);
+  ready_mask = 0;
+  ready_cnt = 0;
   list_init (&all_list);
+  list_init (&mlfqs_ran_list);
   
   /* Set up a thread structure for the running thread. */
   initial_thread = running_thread ();
   init_thread (initial_thread, "main", PRI_DEFAULT);
   initial_thread->status = THREAD_RUNNING;
   initial_thread->tid = allocate_tid ();
+  initial_thread->stamp = timer_cycles ();
 }
 
 /* Starts preemptive thread scheduling by enabling interrupts.
@@ -149,7 +170,8 @@ thread_start (void)
 
 
 /* Calculates recent cpu  by the formula:
-   recent_cpu = (2*load_avg)/(2*load_avg + 1) * recent_cpu + nice. */
+   recent_cpu = (2*load_avg)/(2*load_avg + 1) * recent_cpu + nice.
+   Then recalculates the priority, which depends on it. */
 void 
 mlfqs_update_recent_cpu (struct thread *t, void *aux UNUSED) 
 {
@@ -161,6 +183,7 @@ mlfqs_update_recent_cpu (struct thread *t, void *aux UNUSED)
   tmp = div_reals (tmp, sum_real_int(tmp, 1));
   tmp = mult_reals (tmp, recent_cpu);
   t->mlfqs_recent_cpu = sum_real_int (tmp, nice);
+  mlfqs_update_priority (t, NULL);
 }
 
 /* Calculates the thread priority by the formula:
@@ -185,57 +208,15 @@ mlfqs_calc_priority (const struct thread *t)
   return tmp_priority;
 }
 
-/* Priority update function to be used for every thread.
-   Updates priority of thread every four ticks. */
+/* Recalculates the priority of thread T, placing T at the back
+   of the queue of its new priority if it is ready. */
 void 
 mlfqs_update_priority (struct thread *t, void *aux UNUSED)
 {
-  t->priority = mlfqs_calc_priority (t);
+  thread_set_effective_priority (t, mlfqs_calc_priority (t));
   t->orig_priority = t->priority;
 }
 
-/* Computes the number of ready threads in the mlfqs_ready_list 
-   by summing up the list sizes of each queue of different priority */
-int 
-mlfqs_list_size (void) 
-{
-  int i; 
-  int size = 0;
-  for (i = 0; i <= PRI_MAX; ++i) 
-    {
-      size += list_size (&mlfqs_ready_list[i]);
-    } 
-  return size;
-}
-
-/* Places the threads at the back of the new queue of the corresponding 
-   priority after updating the priority. */
-void 
-mlfqs_reorder_list (void) 
-{
-  int i;
-  ASSERT (intr_get_level () == INTR_OFF);
- 
-  for (i = 0; i <= PRI_MAX; ++i) 
-    {
-      struct list_elem *e = list_begin (&mlfqs_ready_list[i]); 
-  
-      while (e != list_end (&mlfqs_ready_list[i])) 
-	{
-	  struct thread *t = list_entry (e, struct thread, elem);
-	  if (t->priority != i) 
-	    {
-	      e = list_remove (e);
-	      list_push_back (&mlfqs_ready_list[t->priority], &t->elem); 
-	    } 
-	  else 
-	    {
-	      e = list_next (e);
-	    }
-	}
-    }
-}
-
 /* Calculates the load average every second within the 
    thread_tick function. */
 int 
@@ -245,7 +226,7 @@ mlfqs_calc_load_average (const struct thread *t)
   int tmp, tmp2;
   tmp = mult_real_int (mlfqs_load_avg, 59);
   tmp = div_real_int (tmp, 60);
-  int ready_threads = mlfqs_list_size ();
+  int ready_threads = ready_cnt;
   
   if (t != idle_thread)
     ready_threads++;
@@ -261,8 +242,27 @@ mlfqs_calc_load_average (const struct thread *t)
 void
 thread_tick (void) 
 {
-  struct thread *t = thread_current ();
+  account_tick (thread_current ());
+
+  /* Enforce preemption. */
+  if (++thread_ticks >= TIME_SLICE)
+    intr_yield_on_return ();
+}
 
+/* Called by the timer, with interrupts off, for each tick that
+   passed with the CPU idle and the periodic timer interrupt
+   stopped (see timer_idle_enter()). */
+void
+thread_idle_tick (void) 
+{
+  account_tick (idle_thread);
+}
+
+/* Updates the statistics and the MLFQS state for a tick that
+   thread T spent running. */
+static void
+account_tick (struct thread *t) 
+{
   /* Update statistics. */
   if (t == idle_thread)
     idle_ticks++;
@@ -277,37 +277,74 @@ thread_tick (void)
   if (thread_mlfqs) 
     {
       if (t != idle_thread)
-	t->mlfqs_recent_cpu = sum_real_int (t->mlfqs_recent_cpu, 1);
+	{
+	  t->mlfqs_recent_cpu = sum_real_int (t->mlfqs_recent_cpu, 1);
+	  if (!t->mlfqs_ran)
+	    {
+	      list_push_back (&mlfqs_ran_list, &t->mlfqs_elem);
+	      t->mlfqs_ran = true;
+	    }
+	}
 
-      /* recent_cpu recalculated every second */
+      /* recent_cpu, and with it every priority, recalculated
+	 every second */
       if (timer_ticks () % TIMER_FREQ == 0) 
 	{   
 	  mlfqs_load_avg = mlfqs_calc_load_average (t);
-	  
-	  /* recent_cpu update */
 	  thread_foreach (mlfqs_update_recent_cpu, NULL);
 	}
 
-      /* priority recalculated once every fourth clock tick */
-      if (timer_ticks () % 4 == 0) 
-	{
-	  /* try ready list priority update and then do sort */
-	  thread_foreach (mlfqs_update_priority, NULL);
-	  mlfqs_reorder_list ();
-	}      
+      /* priority recalculated once every fourth clock tick.
+	 Between seconds, only the threads that ran since the last
+	 recalculation, even if they have since blocked or yielded,
+	 have a new recent_cpu, so only their priorities can be
+	 stale. */
+      if (timer_ticks () % 4 == 0)
+	while (!list_empty (&mlfqs_ran_list))
+	  {
+	    struct thread *r = list_entry (list_pop_front (&mlfqs_ran_list),
+					   struct thread, mlfqs_elem);
+	    r->mlfqs_ran = false;
+	    mlfqs_update_priority (r, NULL);
+	  }
     }
-
-  /* Enforce preemption. */
-  if (++thread_ticks >= TIME_SLICE)
-    intr_yield_on_return ();
 }
 
-/* Prints thread statistics. */
+/* Prints thread statistics: totals, then run and wait time and
+   switch counts summed over the threads that have exited and for
+   each thread still alive, then the run-queue latency
+   histogram. */
 void
 thread_print_stats (void) 
 {
+  struct list_elem *e;
+  enum intr_level old_level;
+  int i;
+
   printf ("Thread: %lld idle ticks, %lld kernel ticks, %lld user ticks\n",
           idle_ticks, kernel_ticks, user_ticks);
+
+  old_level = intr_disable ();
+  printf ("Thread: %u exited threads: %llu cycles running, %llu waiting, "
+          "%llu voluntary and %llu involuntary switches\n",
+          exited_cnt, exited_run_cycles, exited_wait_cycles,
+          exited_voluntary_cnt, exited_involuntary_cnt);
+  for (e = list_begin (&all_list); e != list_end (&all_list);
+       e = list_next (e))
+    {
+      struct thread *t = list_entry (e, struct thread, allelem);
+      printf ("Thread %s (tid %d): %llu cycles running, %llu waiting, "
+              "%u voluntary and %u involuntary switches\n",
+              t->name, t->tid, t->run_cycles, t->wait_cycles,
+              t->voluntary_cnt, t->involuntary_cnt);
+    }
+  intr_set_level (old_level);
+
+  printf ("Thread: run-queue latency in cycles:");
+  for (i = 0; i < LATENCY_BUCKETS; i++)
+    if (latency_hist[i] != 0)
+      printf (" <2^%d:%llu", i + 1, latency_hist[i]);
+  printf ("\n");
 }
 
 /* Creates a new kernel thread named NAME with the given initial
@@ -416,20 +453,12 @@ thread_unblock (struct thread *t)
 
   old_level = intr_disable ();
   ASSERT (t->status == THREAD_BLOCKED);
-  if (!thread_mlfqs)  
-    {
-      list_sort (&ready_list, priority_compare, NULL);
-      list_insert_ordered (&ready_list, &t->elem, priority_compare, NULL);
-    } 
-  else 
-    {
-      list_push_back (&mlfqs_ready_list[t->priority], &t->elem);    
-    }
-
+  ready_queue_push (t);
   t->status = THREAD_READY;
+  t->stamp = timer_cycles ();
   if (thread_current () != idle_thread && !intr_context ()) 
     {
-      thread_yield ();
+      thread_preempt ();
     }
   intr_set_level (old_level);
 }
@@ -483,6 +512,8 @@ thread_exit (void)
      when it calls thread_schedule_tail(). */
   intr_disable ();
   list_remove (&thread_current ()->allelem);
+  if (thread_current ()->mlfqs_ran)
+    list_remove (&thread_current ()->mlfqs_elem);
   thread_current ()->status = THREAD_DYING;
   schedule ();
   NOT_REACHED ();
@@ -500,17 +531,46 @@ thread_yield (void)
 
   old_level = intr_disable ();
   if (cur != idle_thread) 
+    ready_queue_push (cur);
+
+  cur->status = THREAD_READY;
+  schedule ();
+  intr_set_level (old_level);
+}
+
+/* Yields the CPU because the scheduler wants another thread to
+   run: the running thread's time slice is over, or another
+   thread was woken up.  Like thread_yield(), but the switch
+   counts as involuntary. */
+void
+thread_preempt (void) 
+{
+  enum intr_level old_level = intr_disable ();
+  preempting = true;
+  thread_yield ();
+  intr_set_level (old_level);
+}
+
+/* Yields the CPU directly to thread T, whatever its priority,
+   if T is ready to run, and otherwise like thread_yield().  The
+   current thread goes back on the ready queue either way. */
+void
+thread_yield_to (struct thread *t) 
+{
+  struct thread *cur = thread_current ();
+  enum intr_level old_level;
+
+  ASSERT (!intr_context ());
+  ASSERT (is_thread (t));
+
+  old_level = intr_disable ();
+  if (t->status == THREAD_READY) 
     {
-      if (!thread_mlfqs) 
-	{
-	  list_insert_ordered (&ready_list, &cur->elem, 
-			       priority_compare, NULL);
-	} 
-      else 
-	{
-	  list_push_back (&mlfqs_ready_list[cur->priority], &cur->elem);    
-	}
+      ready_queue_remove (t);
+      yield_target = t;
     }
+  if (cur != idle_thread) 
+    ready_queue_push (cur);
 
   cur->status = THREAD_READY;
   schedule ();
@@ -542,19 +602,57 @@ thread_set_priority (int new_priority)
   enum intr_level old_level;
   old_level = intr_disable ();
 
-  bool priority_donated = (cur->orig_priority != cur->priority);
   cur->orig_priority = new_priority;
-  
-  /* Set the actual priority to new_priority only if
-     new priority is higher than the current actual priority
-     and the actual priority is one that is donated */
-  if ((!priority_donated) || (new_priority > cur->priority)) 
-    cur->priority = new_priority;
+
+  /* Keep a higher priority donated through one of the locks we
+     hold, the first of which has the highest donation */
+  if (!list_empty (&cur->acquired_locks)) 
+    {
+      struct lock *l = list_entry (list_front (&cur->acquired_locks),
+				   struct lock, elem);
+      if (l->priority > new_priority)
+	new_priority = l->priority;
+    }
+  thread_set_effective_priority (cur, new_priority);
 
   intr_set_level (old_level);
   thread_yield ();
 }
 
+/* Sets T's effective priority, the one it is scheduled by, to
+   PRIORITY.  If T is ready, moves it to the back of the ready
+   queue for PRIORITY.  If T is waiting on a semaphore, moves it
+   to its new place in the semaphore's priority-ordered waiters,
+   so that sema_up() can always wake the front one. */
+void
+thread_set_effective_priority (struct thread *t, int priority)
+{
+  enum intr_level old_level;
+
+  ASSERT (is_thread (t));
+  ASSERT (PRI_MIN <= priority && priority <= PRI_MAX);
+
+  old_level = intr_disable ();
+  if (t->priority == priority)
+    ;
+  else if (t->status == THREAD_READY)
+    {
+      ready_queue_remove (t);
+      t->priority = priority;
+      ready_queue_push (t);
+    }
+  else if (t->status == THREAD_BLOCKED && t->waiting_sema != NULL)
+    {
+      list_remove (&t->elem);
+      t->priority = priority;
+      list_insert_ordered (&t->waiting_sema->waiters, &t->elem,
+                           priority_compare, NULL);
+    }
+  else
+    t->priority = priority;
+  intr_set_level (old_level);
+}
+
 /* Returns the current thread's priority. */
 int
 thread_get_priority (void) 
@@ -621,6 +719,10 @@ idle (void *idle_started_ UNUSED)
       intr_disable ();
       thread_block ();
 
+      /* Stop the periodic timer interrupt until a timer is due.
+         Any interrupt still wakes us up. */
+      timer_idle_enter ();
+
       /* Re-enable interrupts and wait for the next one.
 
          The `sti' instruction disables interrupts until the
@@ -683,6 +785,7 @@ init_thread (struct thread *t, const char *name, int priority)
   strlcpy (t->name, name, sizeof t->name);
   t->stack = (uint8_t *) t + PGSIZE;
   t->blocking_lock = NULL;
+  t->waiting_sema = NULL;
   if (!thread_mlfqs) 
     {
       t->priority = priority;
@@ -714,18 +817,52 @@ alloc_frame (struct thread *t, size_t size)
   return t->stack;
 }
 
-/* Returns true if there is no ready thread in the 
-   mlfqs_ready_list */
-bool 
-mlfqs_list_empty (void) 
+/* Returns the index of the most significant set bit in MASK,
+   which must be nonzero. */
+static int
+highest_set_bit (uint64_t mask)
 {
-  int i;
-  for (i = 0; i <= PRI_MAX; ++i) 
-    {
-      if (list_size (&mlfqs_ready_list[i]) > 0) 
-	return false;
-    }
-  return true;
+  uint32_t high = mask >> 32;
+
+  ASSERT (mask != 0);
+  if (high != 0)
+    return 63 - __builtin_clz (high);
+  return 31 - __builtin_clz ((uint32_t) mask);
+}
+
+/* Appends T to the ready queue for its priority. */
+static void
+ready_queue_push (struct thread *t)
+{
+  list_push_back (&ready_queues[t->priority], &t->elem);
+  ready_mask |= (uint64_t) 1 << t->priority;
+  ready_cnt++;
+}
+
+/* Removes ready thread T from its ready queue. */
+static void
+ready_queue_remove (struct thread *t)
+{
+  list_remove (&t->elem);
+  if (list_empty (&ready_queues[t->priority]))
+    ready_mask &= ~((uint64_t) 1 << t->priority);
+  ready_cnt--;
+}
+
+/* Removes and returns the thread at the front of the highest
+   non-empty ready queue, or a null pointer if no thread is
+   ready. */
+static struct thread *
+ready_queue_pop (void)
+{
+  struct thread *t;
+
+  if (ready_mask == 0)
+    return NULL;
+  t = list_entry (list_front (&ready_queues[highest_set_bit (ready_mask)]),
+                  struct thread, elem);
+  ready_queue_remove (t);
+  return t;
 }
 
 /* Chooses and returns the next thread to be scheduled.  Should
@@ -736,35 +873,29 @@ mlfqs_list_empty (void)
 static struct thread *
 next_thread_to_run (void) 
 {
-  struct thread *ret_t = NULL;
-  if (!thread_mlfqs) 
+  struct thread *t = yield_target;
+
+  if (t != NULL)
     {
-      if (list_empty (&ready_list))
-	ret_t = idle_thread;
-      else 
-	ret_t = list_entry (list_pop_front (&ready_list), struct thread, elem);
-    } 
-  else 
+      yield_target = NULL;
+      return t;
+    }
+  t = ready_queue_pop ();
+  return t != NULL ? t : idle_thread;
+}
+
+/* Returns the latency_hist[] bucket for a wait of CYCLES. */
+static int
+latency_bucket (uint64_t cycles)
+{
+  int bucket = 0;
+
+  while (cycles > 1 && bucket < LATENCY_BUCKETS - 1)
     {
-      if (mlfqs_list_empty()) 
-	{
-	  ret_t = idle_thread;
-	} 
-      else 
-	{ 
-	  int i;
-	  for (i = PRI_MAX; i>=0; --i) 
-	    {
-	      if (list_size (&mlfqs_ready_list[i]) > 0) {
-		ret_t = list_entry (list_pop_front (&mlfqs_ready_list[i]), 
-				    struct thread, elem);
-		break;
-	      } 
-	    } 
-	} 
-    } 
-  ASSERT(ret_t!=NULL);
-  return ret_t;
+      cycles >>= 1;
+      bucket++;
+    }
+  return bucket;
 }
 
 /* Completes a thread switch by activating the new thread's page
@@ -790,8 +921,20 @@ thread_schedule_tail (struct thread *prev)
   
   ASSERT (intr_get_level () == INTR_OFF);
 
-  /* Mark us as running. */
+  /* Mark us as running, and account for the time we spent
+     waiting to. */
   cur->status = THREAD_RUNNING;
+  if (prev != NULL)
+    {
+      uint64_t now = timer_cycles ();
+      uint64_t wait = now - cur->stamp;
+      if (cur != idle_thread)
+        {
+          cur->wait_cycles += wait;
+          latency_hist[latency_bucket (wait)]++;
+        }
+      cur->stamp = now;
+    }
 
   /* Start new time slice. */
   thread_ticks = 0;
@@ -806,6 +949,14 @@ thread_schedule_tail (struct thread *prev)
      pull out the rug under itself.  (We don't free
      initial_thread because its memory was not obtained via
      palloc().) */
+  if (prev != NULL && prev->status == THREAD_DYING)
+    {
+      exited_cnt++;
+      exited_run_cycles += prev->run_cycles;
+      exited_wait_cycles += prev->wait_cycles;
+      exited_voluntary_cnt += prev->voluntary_cnt;
+      exited_involuntary_cnt += prev->involuntary_cnt;
+    }
   if (prev != NULL && prev->status == THREAD_DYING && prev != initial_thread) 
     {
       ASSERT (prev != cur);
@@ -831,8 +982,22 @@ schedule (void)
   ASSERT (cur->status != THREAD_RUNNING);
   ASSERT (is_thread (next));
 
+  if (cur == idle_thread)
+    timer_idle_exit ();
   if (cur != next)
-    prev = switch_threads (cur, next);
+    {
+      /* Charge CUR for the time it ran.  If it is still ready,
+         it starts waiting now. */
+      uint64_t now = timer_cycles ();
+      cur->run_cycles += now - cur->stamp;
+      if (preempting)
+        cur->involuntary_cnt++;
+      else
+        cur->voluntary_cnt++;
+      cur->stamp = now;
+      prev = switch_threads (cur, next);
+    }
+  preempting = false;
   thread_schedule_tail (prev);
 }
 
@@ -92,12 +92,23 @@ struct thread
 
     int mlfqs_nice;                     /* nice value for MLFQS */
     int mlfqs_recent_cpu;               /* recent_cpu for MLFQS */
+    struct list_elem mlfqs_elem;        /* Element in mlfqs_ran_list. */
+    bool mlfqs_ran;                     /* In mlfqs_ran_list? */
 
-    struct list acquired_locks;         /* locks that this thread has acquired. */
+    struct list acquired_locks;         /* locks held, by priority. */
     struct lock *blocking_lock;         /* lock that this thread has been blocked by */
+    struct semaphore *waiting_sema;     /* semaphore this thread waits on */
 
     struct list_elem allelem;           /* List element for all threads list. */
 
+    /* Scheduler statistics, in time-stamp counter cycles. */
+    uint64_t run_cycles;                /* Time spent running. */
+    uint64_t wait_cycles;               /* Time spent ready to run. */
+    uint64_t stamp;                     /* When it last started running
+                                           or became ready. */
+    unsigned voluntary_cnt;             /* # of times it gave up the CPU. */
+    unsigned involuntary_cnt;           /* # of times it was preempted. */
+
     /* Shared between thread.c and synch.c. */
     struct list_elem elem;              /* List element. */
 
@@ -119,6 +130,7 @@ void thread_init (void);
 void thread_start (void);
 
 void thread_tick (void);
+void thread_idle_tick (void);
 void thread_print_stats (void);
 
 typedef void thread_func (void *aux);
@@ -133,6 +145,8 @@ const char *thread_name (void);
 
 void thread_exit (void) NO_RETURN;
 void thread_yield (void);
+void thread_preempt (void);
+void thread_yield_to (struct thread *);
 
 /* Performs some operation on thread t, given auxiliary data AUX. */
 typedef void thread_action_func (struct thread *t, void *aux);
@@ -140,6 +154,7 @@ void thread_foreach (thread_action_func *, void *);
 
 int thread_get_priority (void);
 void thread_set_priority (int);
+void thread_set_effective_priority (struct thread *, int);
 
 int thread_get_nice (void);
 void thread_set_nice (int);
@@ -3,7 +3,32 @@
 #include <string.h>
 #include <stdio.h>
 #include "devices/ide.h"
+#include "devices/timer.h"
 #include "threads/malloc.h"
+#include "threads/synch.h"
+#include "threads/thread.h"
+
+/* Number of log2 buckets in each latency histogram. */
+#define TICK_BUCKETS 16
+#define CYCLE_BUCKETS 48
+
+/* Number of recent requests each device remembers. */
+#define TRACE_SIZE 32
+
+/* A completed request, as remembered for tracing. */
+struct block_trace
+  {
+    int64_t submit_ticks;               /* When submitted. */
+    uint64_t cycles;                    /* Submission to completion. */
+    block_sector_t sector;              /* First sector. */
+    block_sector_t cnt;                 /* Number of sectors. */
+    bool write;                         /* Write or read? */
+    bool sequential;                    /* Continued the last transfer? */
+  };
+
+/* If true, block_print_stats() also prints each disk's recent
+   requests.  Set by the -iotrace kernel command-line option. */
+bool block_trace_dump;
 
 /* A block device. */
 struct block
@@ -19,6 +44,31 @@ struct block
 
     unsigned long long read_cnt;        /* Number of sectors read. */
     unsigned long long write_cnt;       /* Number of sectors written. */
+
+    struct lock queue_lock;             /* Protects the members below. */
+    const struct block_iosched *iosched; /* Orders the queued requests. */
+    struct list fifo;                   /* Queued requests, arrival order. */
+    struct list sorted;                 /* Queued requests, sector order,
+                                           if the scheduler keeps them. */
+    size_t queue_depth;                 /* Number of queued requests. */
+    block_sector_t head;                /* Sector after last transfer. */
+    struct condition queue_nonempty;    /* Signaled when queue gains one. */
+    bool has_worker;                    /* Worker thread started? */
+
+    unsigned long long merge_cnt;       /* Requests merged into another. */
+    unsigned long long submit_cnt;      /* Requests submitted. */
+    unsigned long long queue_depth_sum; /* Sum of depths after submit. */
+    size_t max_queue_depth;             /* Deepest the queue has been. */
+
+    /* Tracing, updated only by the worker thread. */
+    unsigned long long seq_cnt;         /* Transfers continuing the last. */
+    unsigned long long random_cnt;      /* Other transfers. */
+    unsigned long long tick_hist[TICK_BUCKETS];   /* Request latencies,
+                                                     by log2 ticks. */
+    unsigned long long cycle_hist[CYCLE_BUCKETS]; /* Request latencies,
+                                                     by log2 cycles. */
+    struct block_trace trace[TRACE_SIZE]; /* Recent requests, a ring. */
+    unsigned long long trace_cnt;       /* Requests ever traced. */
   };
 
 /* List of all block devices. */
@@ -113,6 +163,19 @@ check_sector (struct block *block, block_sector_t sector)
     }
 }
 
+/* Verifies that the CNT sectors starting at SECTOR all lie
+   within BLOCK.  Panics if not. */
+static void
+check_sectors (struct block *block, block_sector_t sector,
+               block_sector_t cnt)
+{
+  ASSERT (cnt > 0);
+  check_sector (block, sector);
+  if (cnt > block->size - sector)
+    PANIC ("Access past end of device %s (sector=%"PRDSNu", cnt=%"PRDSNu", "
+           "size=%"PRDSNu")\n", block_name (block), sector, cnt, block->size);
+}
+
 /* Reads sector SECTOR from BLOCK into BUFFER, which must
    have room for BLOCK_SECTOR_SIZE bytes.
    Internally synchronizes accesses to block devices, so external
@@ -120,9 +183,7 @@ check_sector (struct block *block, block_sector_t sector)
 void
 block_read (struct block *block, block_sector_t sector, void *buffer)
 {
-  check_sector (block, sector);
-  block->ops->read (block->aux, sector, buffer);
-  block->read_cnt++;
+  block_read_multiple (block, sector, 1, buffer);
 }
 
 /* Write sector SECTOR to BLOCK from BUFFER, which must contain
@@ -133,10 +194,528 @@ block_read (struct block *block, block_sector_t sector, void *buffer)
 void
 block_write (struct block *block, block_sector_t sector, const void *buffer)
 {
-  check_sector (block, sector);
-  ASSERT (block->type != BLOCK_FOREIGN);
-  block->ops->write (block->aux, sector, buffer);
-  block->write_cnt++;
+  block_write_multiple (block, sector, 1, buffer);
+}
+
+/* Reads CNT consecutive sectors starting at SECTOR from BLOCK
+   into BUFFER, which must have room for CNT * BLOCK_SECTOR_SIZE
+   bytes.  The request goes through BLOCK's I/O scheduler like
+   any other, so it may be reordered or merged with others.
+   Internally synchronizes accesses to block devices, so external
+   per-block device locking is unneeded. */
+void
+block_read_multiple (struct block *block, block_sector_t sector,
+                     block_sector_t cnt, void *buffer)
+{
+  struct block_request r;
+
+  block_request_init (&r, false, sector, cnt, buffer, NULL, NULL);
+  block_submit (block, &r);
+  block_wait (&r);
+}
+
+/* Writes CNT consecutive sectors starting at SECTOR to BLOCK from
+   BUFFER, which must contain CNT * BLOCK_SECTOR_SIZE bytes.
+   Returns after the block device has acknowledged receiving the
+   data.  The request goes through BLOCK's I/O scheduler like any
+   other, so it may be reordered or merged with others.
+   Internally synchronizes accesses to block devices, so external
+   per-block device locking is unneeded. */
+void
+block_write_multiple (struct block *block, block_sector_t sector,
+                      block_sector_t cnt, const void *buffer)
+{
+  struct block_request r;
+
+  block_request_init (&r, true, sector, cnt, (void *) buffer, NULL, NULL);
+  block_submit (block, &r);
+  block_wait (&r);
+}
+
+/* Transfers CNT sectors starting at SECTOR between BLOCK and
+   BUFFER by calling the driver directly: to BLOCK if WRITE is
+   true, from it otherwise.  Only BLOCK's worker thread calls
+   this. */
+static void
+transfer (struct block *block, bool write, block_sector_t sector,
+          block_sector_t cnt, void *buffer)
+{
+  const struct block_operations *ops = block->ops;
+  uint8_t *p = buffer;
+  block_sector_t i;
+
+  if (write)
+    {
+      if (cnt > 1 && ops->write_multiple != NULL)
+        ops->write_multiple (block->aux, sector, cnt, buffer);
+      else
+        for (i = 0; i < cnt; i++)
+          ops->write (block->aux, sector + i, p + i * BLOCK_SECTOR_SIZE);
+      block->write_cnt += cnt;
+    }
+  else
+    {
+      if (cnt > 1 && ops->read_multiple != NULL)
+        ops->read_multiple (block->aux, sector, cnt, buffer);
+      else
+        for (i = 0; i < cnt; i++)
+          ops->read (block->aux, sector + i, p + i * BLOCK_SECTOR_SIZE);
+      block->read_cnt += cnt;
+    }
+}
+
+/* I/O scheduling.
+
+   Each device's queued requests are ordered by an I/O scheduler.
+   After taking the next request from it, the worker asks it for
+   queued requests that continue that one on disk, in the same
+   direction, and carries the whole run out as one transfer. */
+
+/* Most sectors a run of merged requests may add up to.  Requests
+   whose buffers are not adjacent in memory are staged through a
+   bounce buffer of this size. */
+#define MERGE_MAX_SECTORS 64
+
+/* Ticks a queued read or write may wait before the deadline
+   scheduler serves it ahead of the elevator order. */
+#define READ_EXPIRE (TIMER_FREQ / 10)
+#define WRITE_EXPIRE (TIMER_FREQ / 2)
+
+/* An I/O scheduler.  Its functions are called with the device's
+   queue_lock held. */
+struct block_iosched
+  {
+    const char *name;
+
+    /* Adds R to BLOCK's queue. */
+    void (*add) (struct block *, struct block_request *r);
+
+    /* Removes and returns the request to carry out next from
+       BLOCK's queue, which is not empty. */
+    struct block_request *(*next) (struct block *);
+
+    /* Removes and returns a queued request of at most MAX_CNT
+       sectors in the same direction as PREV that starts at the
+       sector just past PREV's end, or returns a null pointer. */
+    struct block_request *(*merge) (struct block *,
+                                    const struct block_request *prev,
+                                    block_sector_t max_cnt);
+  };
+
+/* Returns true if R continues PREV on disk in the same direction
+   and has no more than MAX_CNT sectors. */
+static bool
+continues (const struct block_request *r, const struct block_request *prev,
+           block_sector_t max_cnt)
+{
+  return (r->write == prev->write
+          && r->sector == prev->sector + prev->cnt
+          && r->cnt <= max_cnt);
+}
+
+/* First-come, first-served scheduler. */
+
+static void
+fifo_add (struct block *block, struct block_request *r)
+{
+  list_push_back (&block->fifo, &r->fifo_elem);
+}
+
+static struct block_request *
+fifo_next (struct block *block)
+{
+  return list_entry (list_pop_front (&block->fifo),
+                     struct block_request, fifo_elem);
+}
+
+/* Merges only with the request at the head of the queue, so that
+   requests are still carried out in arrival order. */
+static struct block_request *
+fifo_merge (struct block *block, const struct block_request *prev,
+            block_sector_t max_cnt)
+{
+  struct block_request *r;
+
+  if (list_empty (&block->fifo))
+    return NULL;
+  r = list_entry (list_front (&block->fifo), struct block_request, fifo_elem);
+  if (!continues (r, prev, max_cnt))
+    return NULL;
+  list_remove (&r->fifo_elem);
+  return r;
+}
+
+static const struct block_iosched fifo_iosched =
+  {
+    "fifo",
+    fifo_add,
+    fifo_next,
+    fifo_merge
+  };
+
+/* Deadline scheduler.  Serves requests in C-LOOK order, sweeping
+   upward from the last sector transferred and then jumping back
+   to the lowest queued sector, unless the oldest request has
+   waited past its deadline, in which case it goes first.
+
+   Keeps every request both in BLOCK's sorted list, ordered by
+   sector, and in its fifo list, in arrival order. */
+
+/* Returns true if request A starts at a lower sector than B. */
+static bool
+request_less (const struct list_elem *a_, const struct list_elem *b_,
+              void *aux UNUSED)
+{
+  const struct block_request *a = list_entry (a_, struct block_request, elem);
+  const struct block_request *b = list_entry (b_, struct block_request, elem);
+
+  return a->sector < b->sector;
+}
+
+static void
+deadline_add (struct block *block, struct block_request *r)
+{
+  r->deadline = timer_ticks () + (r->write ? WRITE_EXPIRE : READ_EXPIRE);
+  list_push_back (&block->fifo, &r->fifo_elem);
+  list_insert_ordered (&block->sorted, &r->elem, request_less, NULL);
+}
+
+static struct block_request *
+deadline_next (struct block *block)
+{
+  struct block_request *r = list_entry (list_front (&block->fifo),
+                                        struct block_request, fifo_elem);
+
+  if (timer_ticks () < r->deadline)
+    {
+      struct list_elem *e;
+
+      /* Continue the upward sweep, or start over at the bottom. */
+      for (e = list_begin (&block->sorted); e != list_end (&block->sorted);
+           e = list_next (e))
+        if (list_entry (e, struct block_request, elem)->sector >= block->head)
+          break;
+      if (e == list_end (&block->sorted))
+        e = list_begin (&block->sorted);
+      r = list_entry (e, struct block_request, elem);
+    }
+
+  list_remove (&r->elem);
+  list_remove (&r->fifo_elem);
+  return r;
+}
+
+static struct block_request *
+deadline_merge (struct block *block, const struct block_request *prev,
+                block_sector_t max_cnt)
+{
+  block_sector_t end = prev->sector + prev->cnt;
+  struct list_elem *e;
+
+  for (e = list_begin (&block->sorted); e != list_end (&block->sorted);
+       e = list_next (e))
+    {
+      struct block_request *r = list_entry (e, struct block_request, elem);
+      if (r->sector > end)
+        break;
+      if (continues (r, prev, max_cnt))
+        {
+          list_remove (&r->elem);
+          list_remove (&r->fifo_elem);
+          return r;
+        }
+    }
+  return NULL;
+}
+
+static const struct block_iosched deadline_iosched =
+  {
+    "deadline",
+    deadline_add,
+    deadline_next,
+    deadline_merge
+  };
+
+/* Available I/O schedulers. */
+static const struct block_iosched *ioscheds[] =
+  {
+    &deadline_iosched,
+    &fifo_iosched,
+  };
+
+/* I/O scheduler given to newly registered devices. */
+static const struct block_iosched *default_iosched = &deadline_iosched;
+
+/* Selects the I/O scheduler named NAME, "deadline" or "fifo", for
+   block devices registered from now on.  Returns true if
+   successful, false if there is no such scheduler. */
+bool
+block_set_iosched (const char *name)
+{
+  size_t i;
+
+  for (i = 0; i < sizeof ioscheds / sizeof *ioscheds; i++)
+    if (!strcmp (name, ioscheds[i]->name))
+      {
+        default_iosched = ioscheds[i];
+        return true;
+      }
+  return false;
+}
+
+/* Initializes R as a request to transfer CNT sectors starting at
+   SECTOR between a block device and BUFFER, which must have room
+   for CNT * BLOCK_SECTOR_SIZE bytes: to the device if WRITE is
+   true, from it otherwise.  On completion DONE_FUNC, if non-null,
+   is called with R and AUX in the device's worker thread;
+   otherwise block_wait() on R returns.  A completion function
+   must not wait for I/O on the same device. */
+void
+block_request_init (struct block_request *r, bool write,
+                    block_sector_t sector, block_sector_t cnt,
+                    void *buffer, block_request_func *done_func, void *aux)
+{
+  ASSERT (r != NULL);
+  ASSERT (cnt > 0);
+  ASSERT (buffer != NULL);
+
+  r->write = write;
+  r->sector = sector;
+  r->cnt = cnt;
+  r->buffer = buffer;
+  r->done_func = done_func;
+  r->aux = aux;
+  r->deadline = 0;
+  r->submit_ticks = 0;
+  r->submit_cycles = 0;
+  sema_init (&r->done, 0);
+}
+
+/* Takes the next request and any requests that can be merged
+   with it off BLOCK's queue and appends them to BATCH in sector
+   order.  Merges up to MAX_CNT sectors.  Returns the number of
+   sectors in the batch.  BLOCK's queue must not be empty, and its
+   queue_lock must be held. */
+static block_sector_t
+take_batch (struct block *block, struct list *batch, block_sector_t max_cnt)
+{
+  const struct block_iosched *iosched = block->iosched;
+  struct block_request *last, *r;
+  block_sector_t cnt;
+
+  ASSERT (lock_held_by_current_thread (&block->queue_lock));
+  ASSERT (block->queue_depth > 0);
+
+  last = iosched->next (block);
+  block->queue_depth--;
+  list_push_back (batch, &last->elem);
+  cnt = last->cnt;
+
+  while (cnt < max_cnt
+         && (r = iosched->merge (block, last, max_cnt - cnt)) != NULL)
+    {
+      block->queue_depth--;
+      block->merge_cnt++;
+      list_push_back (batch, &r->elem);
+      cnt += r->cnt;
+      last = r;
+    }
+
+  block->head = last->sector + last->cnt;
+  return cnt;
+}
+
+/* Carries out the requests in BATCH, a run of CNT sectors in
+   sector order taken by take_batch(), as a single transfer.
+   Uses BOUNCE, if needed, to stage requests whose buffers are not
+   adjacent in memory. */
+static void
+transfer_batch (struct block *block, struct list *batch, block_sector_t cnt,
+                uint8_t *bounce)
+{
+  struct block_request *first = list_entry (list_front (batch),
+                                            struct block_request, elem);
+  bool contiguous = true;
+  struct list_elem *e;
+  uint8_t *p;
+
+  p = first->buffer;
+  for (e = list_begin (batch); e != list_end (batch); e = list_next (e))
+    {
+      struct block_request *r = list_entry (e, struct block_request, elem);
+      if (r->buffer != p)
+        contiguous = false;
+      p = (uint8_t *) r->buffer + r->cnt * BLOCK_SECTOR_SIZE;
+    }
+
+  if (contiguous)
+    {
+      transfer (block, first->write, first->sector, cnt, first->buffer);
+      return;
+    }
+
+  ASSERT (bounce != NULL && cnt <= MERGE_MAX_SECTORS);
+  if (first->write)
+    for (p = bounce, e = list_begin (batch); e != list_end (batch);
+         e = list_next (e))
+      {
+        struct block_request *r = list_entry (e, struct block_request, elem);
+        memcpy (p, r->buffer, r->cnt * BLOCK_SECTOR_SIZE);
+        p += r->cnt * BLOCK_SECTOR_SIZE;
+      }
+  transfer (block, first->write, first->sector, cnt, bounce);
+  if (!first->write)
+    for (p = bounce, e = list_begin (batch); e != list_end (batch);
+         e = list_next (e))
+      {
+        struct block_request *r = list_entry (e, struct block_request, elem);
+        memcpy (r->buffer, p, r->cnt * BLOCK_SECTOR_SIZE);
+        p += r->cnt * BLOCK_SECTOR_SIZE;
+      }
+}
+
+/* Returns the log2 histogram bucket for VALUE in a histogram
+   with BUCKET_CNT buckets: 0 for 0 or 1, 1 for 2 or 3, 2 for 4
+   through 7, and so on, with the last bucket catching the rest. */
+static size_t
+hist_bucket (uint64_t value, size_t bucket_cnt)
+{
+  size_t bucket = 0;
+
+  while (value > 1 && bucket < bucket_cnt - 1)
+    {
+      value >>= 1;
+      bucket++;
+    }
+  return bucket;
+}
+
+/* Records the completion of request R, which was part of a
+   transfer that did or did not continue the previous one
+   according to SEQUENTIAL, in BLOCK's latency histograms and
+   trace ring. */
+static void
+trace_request (struct block *block, const struct block_request *r,
+               bool sequential)
+{
+  int64_t ticks = timer_elapsed (r->submit_ticks);
+  uint64_t cycles = timer_cycles () - r->submit_cycles;
+  struct block_trace *t = &block->trace[block->trace_cnt++ % TRACE_SIZE];
+
+  block->tick_hist[hist_bucket (ticks, TICK_BUCKETS)]++;
+  block->cycle_hist[hist_bucket (cycles, CYCLE_BUCKETS)]++;
+
+  t->submit_ticks = r->submit_ticks;
+  t->cycles = cycles;
+  t->sector = r->sector;
+  t->cnt = r->cnt;
+  t->write = r->write;
+  t->sequential = sequential;
+}
+
+/* Worker thread for BLOCK_.  Takes runs of requests from the
+   queue in the order chosen by the device's I/O scheduler,
+   carries them out and reports their completion. */
+static void
+block_worker (void *block_)
+{
+  struct block *block = block_;
+  uint8_t *bounce = malloc (MERGE_MAX_SECTORS * BLOCK_SECTOR_SIZE);
+
+  /* Without a bounce buffer, carry out requests one at a time. */
+  block_sector_t max_cnt = bounce != NULL ? MERGE_MAX_SECTORS : 0;
+
+  for (;;)
+    {
+      struct list batch;
+      block_sector_t cnt, prev_head;
+      bool sequential;
+
+      list_init (&batch);
+      lock_acquire (&block->queue_lock);
+      while (block->queue_depth == 0)
+        cond_wait (&block->queue_nonempty, &block->queue_lock);
+      prev_head = block->head;
+      cnt = take_batch (block, &batch, max_cnt);
+      lock_release (&block->queue_lock);
+
+      transfer_batch (block, &batch, cnt, bounce);
+
+      sequential = (list_entry (list_front (&batch),
+                                struct block_request, elem)->sector
+                    == prev_head);
+      if (sequential)
+        block->seq_cnt++;
+      else
+        block->random_cnt++;
+
+      /* A request may be freed as soon as it completes, so remove
+         each from the batch first. */
+      while (!list_empty (&batch))
+        {
+          struct block_request *r = list_entry (list_pop_front (&batch),
+                                                struct block_request, elem);
+          trace_request (block, r, sequential);
+          if (r->done_func != NULL)
+            r->done_func (r, r->aux);
+          else
+            sema_up (&r->done);
+        }
+    }
+}
+
+/* Queues request R, which must have been initialized with
+   block_request_init(), on BLOCK and returns without waiting
+   for it.  R and its buffer must stay valid until it completes.
+   If BLOCK is a partition, R's sector is translated to the disk's
+   numbering and R is queued there.  Starts the worker thread of
+   the device R is queued on at first use. */
+void
+block_submit (struct block *block, struct block_request *r)
+{
+  check_sectors (block, r->sector, r->cnt);
+  ASSERT (!r->write || block->type != BLOCK_FOREIGN);
+
+  /* Queue requests to a window onto another device on that
+     device, so that all of a disk's traffic is scheduled together
+     and its worker is the only thread waiting on the disk. */
+  while (block->ops->remap != NULL)
+    {
+      if (r->write)
+        block->write_cnt += r->cnt;
+      else
+        block->read_cnt += r->cnt;
+      block = block->ops->remap (block->aux, &r->sector);
+      check_sectors (block, r->sector, r->cnt);
+    }
+
+  lock_acquire (&block->queue_lock);
+  if (!block->has_worker)
+    {
+      if (thread_create (block->name, PRI_MAX, block_worker, block)
+          == TID_ERROR)
+        PANIC ("%s: failed to start block worker thread", block->name);
+      block->has_worker = true;
+    }
+  r->submit_ticks = timer_ticks ();
+  r->submit_cycles = timer_cycles ();
+  block->iosched->add (block, r);
+  block->queue_depth++;
+  if (block->queue_depth > block->max_queue_depth)
+    block->max_queue_depth = block->queue_depth;
+  block->queue_depth_sum += block->queue_depth;
+  block->submit_cnt++;
+  cond_signal (&block->queue_nonempty, &block->queue_lock);
+  lock_release (&block->queue_lock);
+}
+
+/* Waits for request R, submitted without a completion function,
+   to complete. */
+void
+block_wait (struct block_request *r)
+{
+  ASSERT (r->done_func == NULL);
+  sema_down (&r->done);
 }
 
 /* Returns the number of sectors in BLOCK. */
@@ -164,6 +743,7 @@ block_type (struct block *block)
 void
 block_print_stats (void)
 {
+  struct list_elem *e;
   int i;
 
   for (i = 0; i < BLOCK_ROLE_CNT; i++)
@@ -176,6 +756,65 @@ block_print_stats (void)
                   block->read_cnt, block->write_cnt);
         }
     }
+
+  /* Requests are queued on whole disks, so report scheduling
+     for each device that has had a worker. */
+  for (e = list_begin (&all_blocks); e != list_end (&all_blocks);
+       e = list_next (e))
+    {
+      struct block *block = list_entry (e, struct block, list_elem);
+      if (block->has_worker)
+        {
+          unsigned long long avg_x100
+            = (block->submit_cnt > 0
+               ? block->queue_depth_sum * 100 / block->submit_cnt : 0);
+
+          size_t j;
+
+          printf ("%s: %s scheduler, %llu merges, "
+                  "queue depth %llu.%02llu avg, %zu max\n",
+                  block->name, block->iosched->name, block->merge_cnt,
+                  avg_x100 / 100, avg_x100 % 100, block->max_queue_depth);
+          printf ("%s: %llu bytes read, %llu bytes written, "
+                  "%llu sequential and %llu random transfers\n",
+                  block->name, block->read_cnt * BLOCK_SECTOR_SIZE,
+                  block->write_cnt * BLOCK_SECTOR_SIZE,
+                  block->seq_cnt, block->random_cnt);
+
+          printf ("%s: latency in ticks:", block->name);
+          for (j = 0; j < TICK_BUCKETS; j++)
+            if (block->tick_hist[j] != 0)
+              printf (" <%llu:%llu", 2ULL << j, block->tick_hist[j]);
+          printf ("\n%s: latency in cycles:", block->name);
+          for (j = 0; j < CYCLE_BUCKETS; j++)
+            if (block->cycle_hist[j] != 0)
+              printf (" <2^%zu:%llu", j + 1, block->cycle_hist[j]);
+          printf ("\n");
+
+          if (block_trace_dump)
+            block_print_trace (block);
+        }
+    }
+}
+
+/* Prints the most recent requests carried out on BLOCK, oldest
+   first: submission time, direction, sectors, latency in cycles,
+   and whether the transfer continued the previous one. */
+void
+block_print_trace (struct block *block)
+{
+  unsigned long long i;
+
+  i = block->trace_cnt > TRACE_SIZE ? block->trace_cnt - TRACE_SIZE : 0;
+  for (; i < block->trace_cnt; i++)
+    {
+      const struct block_trace *t = &block->trace[i % TRACE_SIZE];
+      printf ("%s: tick %"PRId64" %s %"PRDSNu"+%"PRDSNu" %"PRIu64
+              " cycles %s\n",
+              block->name, t->submit_ticks, t->write ? "write" : "read",
+              t->sector, t->cnt, t->cycles,
+              t->sequential ? "sequential" : "random");
+    }
 }
 
 /* Registers a new block device with the given NAME.  If
@@ -200,6 +839,23 @@ block_register (const char *name, enum block_type type,
   block->aux = aux;
   block->read_cnt = 0;
   block->write_cnt = 0;
+  lock_init (&block->queue_lock);
+  block->iosched = default_iosched;
+  list_init (&block->fifo);
+  list_init (&block->sorted);
+  block->queue_depth = 0;
+  block->head = 0;
+  cond_init (&block->queue_nonempty);
+  block->has_worker = false;
+  block->merge_cnt = 0;
+  block->submit_cnt = 0;
+  block->queue_depth_sum = 0;
+  block->max_queue_depth = 0;
+  block->seq_cnt = 0;
+  block->random_cnt = 0;
+  memset (block->tick_hist, 0, sizeof block->tick_hist);
+  memset (block->cycle_hist, 0, sizeof block->cycle_hist);
+  block->trace_cnt = 0;
 
   printf ("%s: %'"PRDSNu" sectors (", block->name, block->size);
   print_human_readable_size ((uint64_t) block->size * BLOCK_SECTOR_SIZE);
@@ -1,8 +1,11 @@
 #ifndef DEVICES_BLOCK_H
 #define DEVICES_BLOCK_H
 
+#include <list.h>
+#include <stdbool.h>
 #include <stddef.h>
 #include <inttypes.h>
+#include "threads/synch.h"
 
 /* Size of a block device sector in bytes.
    All IDE disks use this sector size, as do most USB and SCSI
@@ -53,11 +56,56 @@ struct block *block_next (struct block *);
 block_sector_t block_size (struct block *);
 void block_read (struct block *, block_sector_t, void *);
 void block_write (struct block *, block_sector_t, const void *);
+void block_read_multiple (struct block *, block_sector_t, block_sector_t cnt,
+                          void *);
+void block_write_multiple (struct block *, block_sector_t, block_sector_t cnt,
+                           const void *);
 const char *block_name (struct block *);
 enum block_type block_type (struct block *);
 
+/* Asynchronous requests.
+
+   A request is queued on its device with block_submit(), which
+   returns at once; a worker thread per device carries requests
+   out in the order chosen by the device's I/O scheduler, merging
+   requests for adjacent sectors.  The synchronous functions above
+   go through the same queue.  Requests to a partition are queued
+   on its disk, translating the request's sector, so that there
+   is one worker per disk and disks on different IDE channels
+   transfer in parallel.  On completion the worker calls the
+   request's completion function, if any, or else ups its
+   semaphore for block_wait(). */
+struct block_request;
+typedef void block_request_func (struct block_request *, void *aux);
+
+struct block_request
+  {
+    struct list_elem elem;              /* Element in device's queue. */
+    struct list_elem fifo_elem;         /* Element in arrival order. */
+    int64_t deadline;                   /* Serve by this timer tick. */
+    int64_t submit_ticks;               /* timer_ticks() when submitted. */
+    uint64_t submit_cycles;             /* timer_cycles() when submitted. */
+    bool write;                         /* True to write, false to read. */
+    block_sector_t sector;              /* First sector to transfer. */
+    block_sector_t cnt;                 /* Number of sectors. */
+    void *buffer;                       /* CNT * BLOCK_SECTOR_SIZE bytes. */
+    block_request_func *done_func;      /* Completion function, or null. */
+    void *aux;                          /* Passed to DONE_FUNC. */
+    struct semaphore done;              /* Up'd on completion if no
+                                           DONE_FUNC. */
+  };
+
+void block_request_init (struct block_request *, bool write,
+                         block_sector_t sector, block_sector_t cnt,
+                         void *buffer, block_request_func *, void *aux);
+void block_submit (struct block *, struct block_request *);
+void block_wait (struct block_request *);
+bool block_set_iosched (const char *name);
+
 /* Statistics. */
+extern bool block_trace_dump;
 void block_print_stats (void);
+void block_print_trace (struct block *);
 
 /* Lower-level interface to block device drivers. */
 
@@ -65,6 +113,20 @@ struct block_operations
   {
     void (*read) (void *aux, block_sector_t, void *buffer);
     void (*write) (void *aux, block_sector_t, const void *buffer);
+
+    /* Optional.  Transfer CNT consecutive sectors in a single
+       request.  If null, the block layer falls back to one call
+       to read or write per sector. */
+    void (*read_multiple) (void *aux, block_sector_t, block_sector_t cnt,
+                           void *buffer);
+    void (*write_multiple) (void *aux, block_sector_t, block_sector_t cnt,
+                            const void *buffer);
+
+    /* Optional.  For a device that is a window onto part of
+       another, such as a partition, returns the underlying device
+       and translates *SECTOR into its numbering.  Requests are
+       then queued on the underlying device directly. */
+    struct block *(*remap) (void *aux, block_sector_t *sector);
   };
 
 struct block *block_register (const char *name, enum block_type,
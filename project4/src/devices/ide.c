@@ -3,12 +3,15 @@
 #include <debug.h>
 #include <stdbool.h>
 #include <stdio.h>
+#include <string.h>
 #include "devices/block.h"
 #include "devices/partition.h"
 #include "devices/timer.h"
 #include "threads/io.h"
 #include "threads/interrupt.h"
+#include "threads/palloc.h"
 #include "threads/synch.h"
+#include "threads/vaddr.h"
 
 /* The code in this file is an interface to an ATA (IDE)
    controller.  It attempts to comply to [ATA-3]. */
@@ -30,10 +33,29 @@
 #define reg_ctl(CHANNEL) ((CHANNEL)->reg_base + 0x206)  /* Control (w/o). */
 #define reg_alt_status(CHANNEL) reg_ctl (CHANNEL)       /* Alt Status (r/o). */
 
+/* Bus master IDE port addresses, relative to the channel's bus
+   master base. */
+#define reg_bm_command(CHANNEL) ((CHANNEL)->bm_base + 0) /* Command. */
+#define reg_bm_status(CHANNEL) ((CHANNEL)->bm_base + 2)  /* Status. */
+#define reg_bm_prdt(CHANNEL) ((CHANNEL)->bm_base + 4)    /* PRDT address. */
+
+/* Bus Master Command Register bits. */
+#define BM_CMD_START 0x01       /* Start transfer. */
+#define BM_CMD_READ 0x08        /* Transfer from disk to memory. */
+
+/* Bus Master Status Register bits. */
+#define BM_STA_ERR 0x02         /* Error (write 1 to clear). */
+#define BM_STA_INTR 0x04        /* Interrupt (write 1 to clear). */
+
+/* PCI configuration space access ports. */
+#define PCI_CONFIG_ADDR 0xcf8
+#define PCI_CONFIG_DATA 0xcfc
+
 /* Alternate Status Register bits. */
 #define STA_BSY 0x80            /* Busy. */
 #define STA_DRDY 0x40           /* Device Ready. */
 #define STA_DRQ 0x08            /* Data Request. */
+#define STA_ERR 0x01            /* Error. */
 
 /* Control Register bits. */
 #define CTL_SRST 0x04           /* Software Reset. */
@@ -49,6 +71,15 @@
 #define CMD_IDENTIFY_DEVICE 0xec        /* IDENTIFY DEVICE. */
 #define CMD_READ_SECTOR_RETRY 0x20      /* READ SECTOR with retries. */
 #define CMD_WRITE_SECTOR_RETRY 0x30     /* WRITE SECTOR with retries. */
+#define CMD_READ_MULTIPLE 0xc4          /* READ MULTIPLE. */
+#define CMD_WRITE_MULTIPLE 0xc5         /* WRITE MULTIPLE. */
+#define CMD_SET_MULTIPLE_MODE 0xc6      /* SET MULTIPLE MODE. */
+#define CMD_READ_DMA 0xc8               /* READ DMA. */
+#define CMD_WRITE_DMA 0xca              /* WRITE DMA. */
+
+/* Most sectors a single command can transfer.  A sector count
+   register value of 0 stands for this many. */
+#define MAX_TRANSFER_SECTORS 256
 
 /* An ATA device. */
 struct ata_disk
@@ -57,7 +88,22 @@ struct ata_disk
     struct channel *channel;    /* Channel that disk is attached to. */
     int dev_no;                 /* Device 0 or 1 for master or slave. */
     bool is_ata;                /* Is device an ATA disk? */
+    uint8_t multiple_cnt;       /* Sectors per DRQ block for READ/WRITE
+                                   MULTIPLE, or 0 if not enabled. */
+    bool dma;                   /* Use bus master DMA? */
+  };
+
+/* A physical region descriptor, one entry in the table that
+   tells the bus master where to transfer data.  A region may not
+   cross a 64 kB boundary. */
+struct prd
+  {
+    uint32_t addr;              /* Physical address of region. */
+    uint16_t size;              /* Size in bytes, 0 meaning 64 kB. */
+    uint16_t flags;             /* PRD_EOT on the last entry. */
   };
+#define PRD_EOT 0x8000          /* End of table. */
+#define PRD_CNT (PGSIZE / sizeof (struct prd))
 
 /* An ATA channel (aka controller).
    Each channel can control up to two disks. */
@@ -72,6 +118,9 @@ struct channel
                                    any interrupt would be spurious. */
     struct semaphore completion_wait;   /* Up'd by interrupt handler. */
 
+    uint16_t bm_base;           /* Bus master base port, 0 if none. */
+    struct prd *prdt;           /* Page holding the PRD table for DMA. */
+
     struct ata_disk devices[2];     /* The devices on this channel. */
   };
 
@@ -84,8 +133,11 @@ static struct block_operations ide_operations;
 static void reset_channel (struct channel *);
 static bool check_device_type (struct ata_disk *);
 static void identify_ata_device (struct ata_disk *);
+static void set_multiple_mode (struct ata_disk *, uint8_t max_multiple);
+static uint16_t find_bus_master (void);
 
-static void select_sector (struct ata_disk *, block_sector_t);
+static void select_sector (struct ata_disk *, block_sector_t,
+                           block_sector_t cnt);
 static void issue_pio_command (struct channel *, uint8_t command);
 static void input_sector (struct channel *, void *);
 static void output_sector (struct channel *, const void *);
@@ -101,6 +153,7 @@ static void interrupt_handler (struct intr_frame *);
 void
 ide_init (void) 
 {
+  uint16_t bm_base = find_bus_master ();
   size_t chan_no;
 
   for (chan_no = 0; chan_no < CHANNEL_CNT; chan_no++)
@@ -126,6 +179,16 @@ ide_init (void)
       lock_init (&c->lock);
       c->expecting_interrupt = false;
       sema_init (&c->completion_wait, 0);
+
+      /* Set up bus master DMA, if the controller supports it. */
+      c->bm_base = 0;
+      c->prdt = NULL;
+      if (bm_base != 0)
+        {
+          c->prdt = palloc_get_page (0);
+          if (c->prdt != NULL)
+            c->bm_base = bm_base + 8 * chan_no;
+        }
  
       /* Initialize devices. */
       for (dev_no = 0; dev_no < 2; dev_no++)
@@ -136,6 +199,8 @@ ide_init (void)
           d->channel = c;
           d->dev_no = dev_no;
           d->is_ata = false;
+          d->multiple_cnt = 0;
+          d->dma = false;
         }
 
       /* Register interrupt handler. */
@@ -303,12 +368,105 @@ identify_ata_device (struct ata_disk *d)
       return;
     }
 
+  /* Transfer as many sectors per interrupt as the disk allows,
+     and let the controller move the data itself if both it and
+     the disk support DMA (word 49, bit 8). */
+  set_multiple_mode (d, id[47 * 2]);
+  d->dma = c->bm_base != 0 && (id[49 * 2 + 1] & 0x01) != 0;
+  if (d->dma)
+    strlcat (extra_info, ", DMA", sizeof extra_info);
+
   /* Register. */
   block = block_register (d->name, BLOCK_RAW, extra_info, capacity,
                           &ide_operations, d);
   partition_scan (block);
 }
 
+/* Enables READ/WRITE MULTIPLE on disk D with blocks of
+   MAX_MULTIPLE sectors, the limit reported by IDENTIFY DEVICE.
+   Leaves D's multiple_cnt at 0 if the disk does not support it,
+   in which case multi-sector transfers fall back to READ/WRITE
+   SECTOR with one interrupt per sector. */
+static void
+set_multiple_mode (struct ata_disk *d, uint8_t max_multiple)
+{
+  struct channel *c = d->channel;
+
+  /* The block size must be a power of 2. */
+  if (max_multiple == 0 || (max_multiple & (max_multiple - 1)) != 0)
+    return;
+
+  select_device_wait (d);
+  outb (reg_nsect (c), max_multiple);
+  issue_pio_command (c, CMD_SET_MULTIPLE_MODE);
+  sema_down (&c->completion_wait);
+  wait_while_busy (d);
+  if ((inb (reg_alt_status (c)) & STA_ERR) == 0)
+    d->multiple_cnt = max_multiple;
+}
+
+/* Reads 32-bit register REG from the configuration space of PCI
+   function FUNC of device DEV on bus BUS. */
+static uint32_t
+pci_read_config (int bus, int dev, int func, int reg)
+{
+  outl (PCI_CONFIG_ADDR,
+        0x80000000 | (bus << 16) | (dev << 11) | (func << 8) | (reg & 0xfc));
+  return inl (PCI_CONFIG_DATA);
+}
+
+/* Writes VALUE to 32-bit register REG in the configuration space
+   of PCI function FUNC of device DEV on bus BUS. */
+static void
+pci_write_config (int bus, int dev, int func, int reg, uint32_t value)
+{
+  outl (PCI_CONFIG_ADDR,
+        0x80000000 | (bus << 16) | (dev << 11) | (func << 8) | (reg & 0xfc));
+  outl (PCI_CONFIG_DATA, value);
+}
+
+/* Looks on PCI bus 0 for an IDE controller in legacy
+   (compatibility) mode that can act as a bus master, such as the
+   PIIX emulated by QEMU and Bochs.  If one is found, enables bus
+   mastering on it and returns the base of its bus master I/O
+   ports, with the primary channel's registers at the base and
+   the secondary's 8 bytes above.  Otherwise, returns 0. */
+static uint16_t
+find_bus_master (void)
+{
+  int dev, func;
+
+  for (dev = 0; dev < 32; dev++)
+    for (func = 0; func < 8; func++)
+      {
+        uint32_t class, bar4;
+        uint8_t prog_if;
+
+        if ((pci_read_config (0, dev, func, 0x00) & 0xffff) == 0xffff)
+          continue;
+
+        /* Mass storage controller (0x01), IDE (0x01), both
+           channels in compatibility mode, bus master capable. */
+        class = pci_read_config (0, dev, func, 0x08);
+        prog_if = class >> 8;
+        if ((class >> 16) != 0x0101
+            || (prog_if & 0x05) != 0 || (prog_if & 0x80) == 0)
+          continue;
+
+        /* BAR4 holds the bus master I/O base. */
+        bar4 = pci_read_config (0, dev, func, 0x20);
+        if ((bar4 & 1) == 0 || (bar4 & 0xfffc) == 0)
+          continue;
+
+        /* Enable I/O space and bus mastering in the command
+           register. */
+        pci_write_config (0, dev, func, 0x04,
+                          pci_read_config (0, dev, func, 0x04) | 0x05);
+        return bar4 & 0xfffc;
+      }
+  return 0;
+}
+
 /* Translates STRING, which consists of SIZE bytes in a funky
    format, into a null-terminated string in-place.  Drops
    trailing whitespace and null bytes.  Returns STRING.  */
@@ -337,6 +495,156 @@ descramble_ata_string (char *string, int size)
   return string;
 }
 
+/* Returns true if BUFFER can be the target of a bus master
+   transfer.  The bus master needs a physical address, which
+   kernel virtual addresses map to directly, and word alignment. */
+static bool
+dma_usable (const struct ata_disk *d, const void *buffer)
+{
+  return d->dma && is_kernel_vaddr (buffer) && ((uintptr_t) buffer & 1) == 0;
+}
+
+/* Fills in channel C's PRD table to describe the SIZE bytes at
+   BUFFER, splitting the physically contiguous region at 64 kB
+   boundaries as the bus master requires. */
+static void
+build_prdt (struct channel *c, const void *buffer, size_t size)
+{
+  uintptr_t paddr = vtop (buffer);
+  struct prd *prd = c->prdt;
+
+  ASSERT (size > 0);
+  while (size > 0)
+    {
+      size_t chunk = 0x10000 - (paddr & 0xffff);
+      if (chunk > size)
+        chunk = size;
+
+      ASSERT (prd < c->prdt + PRD_CNT);
+      prd->addr = paddr;
+      prd->size = chunk & 0xffff;
+      prd->flags = 0;
+      prd++;
+
+      paddr += chunk;
+      size -= chunk;
+    }
+  prd[-1].flags = PRD_EOT;
+}
+
+/* Transfers CNT sectors, at most MAX_TRANSFER_SECTORS, starting
+   at SEC_NO between disk D and BUFFER using bus master DMA:
+   from the disk if WRITE is false, to it otherwise.  The thread
+   sleeps until the completion interrupt, leaving the CPU to
+   others.  The caller must hold D's channel lock. */
+static void
+dma_transfer (struct ata_disk *d, block_sector_t sec_no, block_sector_t cnt,
+              const void *buffer, bool write)
+{
+  struct channel *c = d->channel;
+  uint8_t direction = write ? 0 : BM_CMD_READ;
+  uint8_t bm_status;
+
+  ASSERT (cnt > 0 && cnt <= MAX_TRANSFER_SECTORS);
+
+  build_prdt (c, buffer, cnt * BLOCK_SECTOR_SIZE);
+  outl (reg_bm_prdt (c), vtop (c->prdt));
+  outb (reg_bm_command (c), direction);
+  outb (reg_bm_status (c), inb (reg_bm_status (c)) | BM_STA_ERR | BM_STA_INTR);
+
+  select_sector (d, sec_no, cnt);
+  issue_pio_command (c, write ? CMD_WRITE_DMA : CMD_READ_DMA);
+  outb (reg_bm_command (c), direction | BM_CMD_START);
+  sema_down (&c->completion_wait);
+
+  /* Stop the bus master and acknowledge its status. */
+  outb (reg_bm_command (c), direction);
+  bm_status = inb (reg_bm_status (c));
+  outb (reg_bm_status (c), bm_status | BM_STA_ERR | BM_STA_INTR);
+  if ((bm_status & BM_STA_ERR) != 0
+      || (inb (reg_alt_status (c)) & STA_ERR) != 0)
+    PANIC ("%s: disk DMA %s failed, sector=%"PRDSNu,
+           d->name, write ? "write" : "read", sec_no);
+}
+
+/* Reads CNT sectors, at most MAX_TRANSFER_SECTORS, starting at
+   SEC_NO from disk D into BUFFER with a single command.  The
+   caller must hold D's channel lock. */
+static void
+read_sectors (struct ata_disk *d, block_sector_t sec_no, block_sector_t cnt,
+              uint8_t *buffer)
+{
+  struct channel *c = d->channel;
+  block_sector_t per_block = d->multiple_cnt > 0 ? d->multiple_cnt : 1;
+  block_sector_t done;
+
+  ASSERT (cnt > 0 && cnt <= MAX_TRANSFER_SECTORS);
+
+  if (dma_usable (d, buffer))
+    {
+      dma_transfer (d, sec_no, cnt, buffer, false);
+      return;
+    }
+
+  select_sector (d, sec_no, cnt);
+  issue_pio_command (c, (d->multiple_cnt > 0 && cnt > 1
+                         ? CMD_READ_MULTIPLE : CMD_READ_SECTOR_RETRY));
+
+  /* The disk interrupts once per DRQ block when it is ready to
+     hand it over. */
+  for (done = 0; done < cnt; )
+    {
+      block_sector_t n = cnt - done < per_block ? cnt - done : per_block;
+      sema_down (&c->completion_wait);
+      if (!wait_while_busy (d))
+        PANIC ("%s: disk read failed, sector=%"PRDSNu,
+               d->name, sec_no + done);
+      for (; n > 0; n--, done++)
+        input_sector (c, buffer + done * BLOCK_SECTOR_SIZE);
+    }
+}
+
+/* Writes CNT sectors, at most MAX_TRANSFER_SECTORS, starting at
+   SEC_NO to disk D from BUFFER with a single command.  Returns
+   after the disk has acknowledged receiving the data.  The
+   caller must hold D's channel lock. */
+static void
+write_sectors (struct ata_disk *d, block_sector_t sec_no, block_sector_t cnt,
+               const uint8_t *buffer)
+{
+  struct channel *c = d->channel;
+  block_sector_t per_block = d->multiple_cnt > 0 ? d->multiple_cnt : 1;
+  block_sector_t done;
+
+  ASSERT (cnt > 0 && cnt <= MAX_TRANSFER_SECTORS);
+
+  if (dma_usable (d, buffer))
+    {
+      dma_transfer (d, sec_no, cnt, buffer, true);
+      return;
+    }
+
+  select_sector (d, sec_no, cnt);
+  issue_pio_command (c, (d->multiple_cnt > 0 && cnt > 1
+                         ? CMD_WRITE_MULTIPLE : CMD_WRITE_SECTOR_RETRY));
+
+  /* The first DRQ block is requested without an interrupt, each
+     later one after an interrupt, and a final interrupt
+     acknowledges the last. */
+  for (done = 0; done < cnt; )
+    {
+      block_sector_t n = cnt - done < per_block ? cnt - done : per_block;
+      if (done > 0)
+        sema_down (&c->completion_wait);
+      if (!wait_while_busy (d))
+        PANIC ("%s: disk write failed, sector=%"PRDSNu,
+               d->name, sec_no + done);
+      for (; n > 0; n--, done++)
+        output_sector (c, buffer + done * BLOCK_SECTOR_SIZE);
+    }
+  sema_down (&c->completion_wait);
+}
+
 /* Reads sector SEC_NO from disk D into BUFFER, which must have
    room for BLOCK_SECTOR_SIZE bytes.
    Internally synchronizes accesses to disks, so external
@@ -347,12 +655,7 @@ ide_read (void *d_, block_sector_t sec_no, void *buffer)
   struct ata_disk *d = d_;
   struct channel *c = d->channel;
   lock_acquire (&c->lock);
-  select_sector (d, sec_no);
-  issue_pio_command (c, CMD_READ_SECTOR_RETRY);
-  sema_down (&c->completion_wait);
-  if (!wait_while_busy (d))
-    PANIC ("%s: disk read failed, sector=%"PRDSNu, d->name, sec_no);
-  input_sector (c, buffer);
+  read_sectors (d, sec_no, 1, buffer);
   lock_release (&c->lock);
 }
 
@@ -367,33 +670,85 @@ ide_write (void *d_, block_sector_t sec_no, const void *buffer)
   struct ata_disk *d = d_;
   struct channel *c = d->channel;
   lock_acquire (&c->lock);
-  select_sector (d, sec_no);
-  issue_pio_command (c, CMD_WRITE_SECTOR_RETRY);
-  if (!wait_while_busy (d))
-    PANIC ("%s: disk write failed, sector=%"PRDSNu, d->name, sec_no);
-  output_sector (c, buffer);
-  sema_down (&c->completion_wait);
+  write_sectors (d, sec_no, 1, buffer);
+  lock_release (&c->lock);
+}
+
+/* Reads CNT sectors starting at SEC_NO from disk D into BUFFER,
+   which must have room for CNT * BLOCK_SECTOR_SIZE bytes.  Issues
+   one command per MAX_TRANSFER_SECTORS sectors.
+   Internally synchronizes accesses to disks, so external
+   per-disk locking is unneeded. */
+static void
+ide_read_multiple (void *d_, block_sector_t sec_no, block_sector_t cnt,
+                   void *buffer_)
+{
+  struct ata_disk *d = d_;
+  struct channel *c = d->channel;
+  uint8_t *buffer = buffer_;
+
+  lock_acquire (&c->lock);
+  while (cnt > 0)
+    {
+      block_sector_t n = (cnt < MAX_TRANSFER_SECTORS
+                          ? cnt : MAX_TRANSFER_SECTORS);
+      read_sectors (d, sec_no, n, buffer);
+      sec_no += n;
+      cnt -= n;
+      buffer += n * BLOCK_SECTOR_SIZE;
+    }
+  lock_release (&c->lock);
+}
+
+/* Writes CNT sectors starting at SEC_NO to disk D from BUFFER,
+   which must contain CNT * BLOCK_SECTOR_SIZE bytes.  Issues one
+   command per MAX_TRANSFER_SECTORS sectors and returns after the
+   disk has acknowledged receiving all of the data.
+   Internally synchronizes accesses to disks, so external
+   per-disk locking is unneeded. */
+static void
+ide_write_multiple (void *d_, block_sector_t sec_no, block_sector_t cnt,
+                    const void *buffer_)
+{
+  struct ata_disk *d = d_;
+  struct channel *c = d->channel;
+  const uint8_t *buffer = buffer_;
+
+  lock_acquire (&c->lock);
+  while (cnt > 0)
+    {
+      block_sector_t n = (cnt < MAX_TRANSFER_SECTORS
+                          ? cnt : MAX_TRANSFER_SECTORS);
+      write_sectors (d, sec_no, n, buffer);
+      sec_no += n;
+      cnt -= n;
+      buffer += n * BLOCK_SECTOR_SIZE;
+    }
   lock_release (&c->lock);
 }
 
 static struct block_operations ide_operations =
   {
     ide_read,
-    ide_write
+    ide_write,
+    ide_read_multiple,
+    ide_write_multiple,
+    NULL
   };
 
 /* Selects device D, waiting for it to become ready, and then
-   writes SEC_NO to the disk's sector selection registers.  (We
-   use LBA mode.) */
+   writes SEC_NO and the sector count CNT to the disk's sector
+   selection registers.  (We use LBA mode.) */
 static void
-select_sector (struct ata_disk *d, block_sector_t sec_no)
+select_sector (struct ata_disk *d, block_sector_t sec_no, block_sector_t cnt)
 {
   struct channel *c = d->channel;
 
   ASSERT (sec_no < (1UL << 28));
+  ASSERT (cnt > 0 && cnt <= MAX_TRANSFER_SECTORS);
   
   select_device_wait (d);
-  outb (reg_nsect (c), 1);
+  outb (reg_nsect (c), cnt % MAX_TRANSFER_SECTORS);
   outb (reg_lbal (c), sec_no);
   outb (reg_lbam (c), sec_no >> 8);
   outb (reg_lbah (c), (sec_no >> 16));
@@ -402,7 +757,8 @@ select_sector (struct ata_disk *d, block_sector_t sec_no)
 }
 
 /* Writes COMMAND to channel C and prepares for receiving a
-   completion interrupt. */
+   completion interrupt.  Used for DMA commands as well as PIO
+   ones. */
 static void
 issue_pio_command (struct channel *c, uint8_t command) 
 {
@@ -0,0 +1,89 @@
+#include "devices/ramdisk.h"
+#include <debug.h>
+#include <round.h>
+#include <stdio.h>
+#include <string.h>
+#include "devices/block.h"
+#include "threads/malloc.h"
+#include "threads/palloc.h"
+#include "threads/vaddr.h"
+
+/* A block device whose sectors are kept in kernel memory.
+
+   Its contents do not survive a reboot, but it transfers data
+   with nothing but memcpy(), which makes it useful for measuring
+   file system overhead apart from disk latency and as fast
+   scratch or swap space.  It is registered as a raw device, so
+   it takes on a role only when named, e.g. "-filesys=ram0". */
+
+/* Sectors per page of backing memory. */
+#define SECTORS_PER_PAGE (PGSIZE / BLOCK_SECTOR_SIZE)
+
+/* Pages holding the RAM disk's sectors.  The pages need not be
+   contiguous, so a large disk does not depend on finding a
+   large run of free memory. */
+static void **pages;
+
+static struct block_operations ramdisk_operations;
+
+/* Returns the address of sector SECTOR's data. */
+static uint8_t *
+sector_addr (block_sector_t sector)
+{
+  return ((uint8_t *) pages[sector / SECTORS_PER_PAGE]
+          + sector % SECTORS_PER_PAGE * BLOCK_SECTOR_SIZE);
+}
+
+/* Creates a zero-filled RAM disk of SIZE_KB kilobytes, rounded up
+   to a whole number of pages, and registers it as "ram0".  Its
+   memory comes from the kernel pool.  Returns the new block
+   device. */
+struct block *
+ramdisk_init (size_t size_kb)
+{
+  size_t page_cnt = DIV_ROUND_UP (size_kb * 1024, PGSIZE);
+  size_t i;
+
+  ASSERT (pages == NULL);
+  if (page_cnt == 0)
+    PANIC ("ram0: disk size must be nonzero");
+
+  pages = malloc (page_cnt * sizeof *pages);
+  if (pages == NULL)
+    PANIC ("ram0: not enough memory for %zu kB disk", size_kb);
+  for (i = 0; i < page_cnt; i++)
+    {
+      pages[i] = palloc_get_page (PAL_ZERO);
+      if (pages[i] == NULL)
+        PANIC ("ram0: not enough memory for %zu kB disk", size_kb);
+    }
+
+  return block_register ("ram0", BLOCK_RAW, "RAM disk",
+                         page_cnt * SECTORS_PER_PAGE,
+                         &ramdisk_operations, NULL);
+}
+
+/* Reads sector SECTOR from the RAM disk into BUFFER, which must
+   have room for BLOCK_SECTOR_SIZE bytes. */
+static void
+ramdisk_read (void *aux UNUSED, block_sector_t sector, void *buffer)
+{
+  memcpy (buffer, sector_addr (sector), BLOCK_SECTOR_SIZE);
+}
+
+/* Writes sector SECTOR to the RAM disk from BUFFER, which must
+   contain BLOCK_SECTOR_SIZE bytes. */
+static void
+ramdisk_write (void *aux UNUSED, block_sector_t sector, const void *buffer)
+{
+  memcpy (sector_addr (sector), buffer, BLOCK_SECTOR_SIZE);
+}
+
+static struct block_operations ramdisk_operations =
+  {
+    ramdisk_read,
+    ramdisk_write,
+    NULL,
+    NULL,
+    NULL
+  };
@@ -24,19 +24,50 @@ static int64_t ticks;
    Initialized by timer_calibrate(). */
 static unsigned loops_per_tick;
 
+/* Timer wheel.  A timer due within the next WHEEL1_SIZE ticks
+   sits in wheel1, which has one slot per tick.  One due within
+   the next WHEEL1_SIZE * WHEEL2_SIZE ticks sits in wheel2, which
+   has one slot per WHEEL1_SIZE ticks, and moves down into wheel1
+   when wheel1 wraps around to the start of its slot.  Later
+   timers wait in far_timers, which is redistributed each time
+   wheel2 wraps around.  So adding a timer and running it are
+   both constant time.  Protected by disabling interrupts, which
+   lets the timer interrupt always run every timer that is due. */
+#define WHEEL1_BITS 8
+#define WHEEL1_SIZE (1 << WHEEL1_BITS)
+#define WHEEL2_BITS 6
+#define WHEEL2_SIZE (1 << WHEEL2_BITS)
+static struct list wheel1[WHEEL1_SIZE];
+static struct list wheel2[WHEEL2_SIZE];
+static struct list far_timers;
+
+/* Earliest tick whose timers have not run yet. */
+static int64_t wheel_ticks;
+
 static intr_handler_func timer_interrupt;
 static bool too_many_loops (unsigned loops);
 static void busy_wait (int64_t loops);
 static void real_time_sleep (int64_t num, int32_t denom);
 static void real_time_delay (int64_t num, int32_t denom);
+static timer_func wake_sleeper;
+static void wheel_insert (struct timer *);
+static void wheel_cascade (struct list *);
+static void run_timers (void);
 
 /* Sets up the timer to interrupt TIMER_FREQ times per second,
    and registers the corresponding interrupt. */
 void
 timer_init (void) 
 {
+  int i;
+
   pit_configure_channel (0, 2, TIMER_FREQ);
   intr_register_ext (0x20, timer_interrupt, "8254 Timer");
+  for (i = 0; i < WHEEL1_SIZE; i++)
+    list_init (&wheel1[i]);
+  for (i = 0; i < WHEEL2_SIZE; i++)
+    list_init (&wheel2[i]);
+  list_init (&far_timers);
 }
 
 /* Calibrates loops_per_tick, used to implement brief delays. */
@@ -76,6 +107,17 @@ timer_ticks (void)
   return t;
 }
 
+/* Returns the CPU's time-stamp counter, the number of clock
+   cycles since it was reset.  Much finer grained than
+   timer_ticks(), for timing short events. */
+uint64_t
+timer_cycles (void)
+{
+  uint64_t tsc;
+  asm volatile ("rdtsc" : "=A" (tsc));
+  return tsc;
+}
+
 /* Returns the number of timer ticks elapsed since THEN, which
    should be a value once returned by timer_ticks(). */
 int64_t
@@ -89,11 +131,46 @@ timer_elapsed (int64_t then)
 void
 timer_sleep (int64_t ticks) 
 {
-  int64_t start = timer_ticks ();
+  struct timer timer;
+  struct semaphore sema;
 
   ASSERT (intr_get_level () == INTR_ON);
-  while (timer_elapsed (start) < ticks) 
-    thread_yield ();
+  if (ticks <= 0)
+    return;
+
+  sema_init (&sema, 0);
+  timer_add (&timer, ticks, wake_sleeper, &sema);
+  sema_down (&sema);
+}
+
+/* Timer function for timer_sleep().  Wakes up the thread that
+   is waiting on semaphore SEMA_. */
+static void
+wake_sleeper (void *sema_) 
+{
+  struct semaphore *sema = sema_;
+  sema_up (sema);
+}
+
+/* Arranges for FUNC to be called with AUX as its argument, from
+   the timer interrupt with interrupts off, once TICKS timer ticks
+   from now have passed, or at the next tick if TICKS <= 0.
+   TIMER must stay valid until then.  May be called from an
+   interrupt handler, including from a timer function. */
+void
+timer_add (struct timer *timer, int64_t ticks, timer_func *func, void *aux) 
+{
+  enum intr_level old_level;
+
+  ASSERT (timer != NULL);
+  ASSERT (func != NULL);
+
+  timer->func = func;
+  timer->aux = aux;
+  old_level = intr_disable ();
+  timer->expires = timer_ticks () + ticks;
+  wheel_insert (timer);
+  intr_set_level (old_level);
 }
 
 /* Sleeps for approximately MS milliseconds.  Interrupts must be
@@ -172,6 +249,77 @@ timer_interrupt (struct intr_frame *args UNUSED)
 {
   ticks++;
   thread_tick ();
+  run_timers ();
+}
+
+/* Adds TIMER to the wheel slot for its expiry tick, or to the
+   slot for the next tick if that has already passed.  Interrupts
+   must be off. */
+static void
+wheel_insert (struct timer *timer) 
+{
+  int64_t delta = timer->expires - wheel_ticks;
+  struct list *slot;
+
+  ASSERT (intr_get_level () == INTR_OFF);
+
+  if (delta < 0)
+    slot = &wheel1[wheel_ticks & (WHEEL1_SIZE - 1)];
+  else if (delta < WHEEL1_SIZE)
+    slot = &wheel1[timer->expires & (WHEEL1_SIZE - 1)];
+  else if (delta < WHEEL1_SIZE * WHEEL2_SIZE)
+    slot = &wheel2[(timer->expires >> WHEEL1_BITS) & (WHEEL2_SIZE - 1)];
+  else
+    slot = &far_timers;
+  list_push_back (slot, &timer->elem);
+}
+
+/* Moves the timers in SLOT into the slots that now match their
+   expiry ticks, which are finer grained as those ticks draw
+   near. */
+static void
+wheel_cascade (struct list *slot) 
+{
+  struct list timers;
+
+  list_init (&timers);
+  list_splice (list_end (&timers), list_begin (slot), list_end (slot));
+  while (!list_empty (&timers))
+    wheel_insert (list_entry (list_pop_front (&timers),
+                              struct timer, elem));
+}
+
+/* Runs every timer that is due by the current tick. */
+static void
+run_timers (void) 
+{
+  while (wheel_ticks <= ticks)
+    {
+      int idx = wheel_ticks & (WHEEL1_SIZE - 1);
+      struct list expired;
+
+      if (idx == 0)
+        {
+          int idx2 = (wheel_ticks >> WHEEL1_BITS) & (WHEEL2_SIZE - 1);
+          if (idx2 == 0)
+            wheel_cascade (&far_timers);
+          wheel_cascade (&wheel2[idx2]);
+        }
+
+      /* Detach the slot before running its timers, which may add
+         new timers, and advance past it so that timers added for
+         this tick go to the next one. */
+      list_init (&expired);
+      list_splice (list_end (&expired), list_begin (&wheel1[idx]),
+                   list_end (&wheel1[idx]));
+      wheel_ticks++;
+      while (!list_empty (&expired))
+        {
+          struct timer *timer = list_entry (list_pop_front (&expired),
+                                            struct timer, elem);
+          timer->func (timer->aux);
+        }
+    }
 }
 
 /* Returns true if LOOPS iterations waits for more than one timer
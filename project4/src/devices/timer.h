@@ -1,6 +1,7 @@
 #ifndef DEVICES_TIMER_H
 #define DEVICES_TIMER_H
 
+#include <list.h>
 #include <round.h>
 #include <stdint.h>
 
@@ -12,6 +13,7 @@ void timer_calibrate (void);
 
 int64_t timer_ticks (void);
 int64_t timer_elapsed (int64_t);
+uint64_t timer_cycles (void);
 
 /* Sleep and yield the CPU to other threads. */
 void timer_sleep (int64_t ticks);
@@ -19,6 +21,19 @@ void timer_msleep (int64_t milliseconds);
 void timer_usleep (int64_t microseconds);
 void timer_nsleep (int64_t nanoseconds);
 
+/* A one-shot timer.  The caller owns its storage, which must
+   stay valid until FUNC has been called. */
+typedef void timer_func (void *aux);
+struct timer
+  {
+    struct list_elem elem;      /* Element in a timer wheel slot. */
+    int64_t expires;            /* Tick at which to call FUNC. */
+    timer_func *func;           /* Called from the timer interrupt. */
+    void *aux;                  /* Passed to FUNC. */
+  };
+
+void timer_add (struct timer *, int64_t ticks, timer_func *, void *aux);
+
 /* Busy waits. */
 void timer_mdelay (int64_t milliseconds);
 void timer_udelay (int64_t microseconds);
@@ -24,38 +24,49 @@ list_dir (const char *dir, bool verbose)
 
   if (isdir (dir_fd))
     {
-      char name[READDIR_MAX_LEN];
+      static char buffer[1024];
+      int size;
 
       printf ("%s", dir);
       if (verbose)
         printf (" (inumber %d)", inumber (dir_fd));
       printf (":\n");
 
-      while (readdir (dir_fd, name)) 
+      /* Fetch many entries per system call.  Each entry carries
+         its inumber and type, so only plain files need to be
+         opened, to get their sizes. */
+      while ((size = readdir_batch (dir_fd, buffer, sizeof buffer)) > 0)
         {
-          printf ("%s", name); 
-          if (verbose) 
-            {
-              char full_name[128];
-              int entry_fd;
-
-              snprintf (full_name, sizeof full_name, "%s/%s", dir, name);
-              entry_fd = open (full_name);
+          const struct readdir_entry *e;
+          int ofs;
 
-              printf (": ");
-              if (entry_fd != -1)
+          for (ofs = 0; ofs < size; ofs += e->rec_len)
+            {
+              e = (const struct readdir_entry *) (buffer + ofs);
+              printf ("%s", e->name); 
+              if (verbose) 
                 {
-                  if (isdir (entry_fd))
+                  printf (": ");
+                  if (e->is_dir)
                     printf ("directory");
                   else
-                    printf ("%d-byte file", filesize (entry_fd));
-                  printf (", inumber %d", inumber (entry_fd));
+                    {
+                      char full_name[128 + READDIR_MAX_LEN];
+                      int entry_fd;
+
+                      snprintf (full_name, sizeof full_name, "%s/%s",
+                                dir, e->name);
+                      entry_fd = open (full_name);
+                      if (entry_fd != -1)
+                        printf ("%d-byte file", filesize (entry_fd));
+                      else
+                        printf ("open failed");
+                      close (entry_fd);
+                    }
+                  printf (", inumber %d", e->inumber);
                 }
-              else
-                printf ("open failed");
-              close (entry_fd);
+              printf ("\n");
             }
-          printf ("\n");
         }
     }
   else 
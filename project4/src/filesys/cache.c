@@ -6,16 +6,32 @@
 #include <stdbool.h>
 #include <string.h>
 #include <stdio.h>
+#include <stdlib.h>
+#include "filesys/journal.h"
 #include "filesys/off_t.h"
+#include "threads/malloc.h"
 
 static struct lock cache_lock;
 static struct bitmap *used_slots;
 
 #define CACHE_SIZE 64
 
+/* Fewest slots that never hold uncommitted metadata, which stays
+   in the cache, so that eviction always finds a victim. */
+#define CACHE_MIN_UNPINNED 16
+
+#if JOURNAL_MAX_SECTORS > CACHE_SIZE - CACHE_MIN_UNPINNED
+#error JOURNAL_MAX_SECTORS would let metadata pin too much of the cache
+#endif
+
+/* Most neighbouring dirty sectors written along with an evicted
+   one, on each side. */
+#define EVICT_CLUSTER 8
+
 struct cache_slot {
   bool accessed;                    // For LRU algorithm
   bool dirty;                       // For write-behind
+  bool meta;                        // Metadata, written via journal
   struct block *block;              // Filesys block pointer
   block_sector_t sector;            // Sector number
   struct lock cs_lock;              // Lock for this slot
@@ -32,6 +48,7 @@ _cache_slot_init (uint32_t index)
 {
   cache[index].accessed = false;
   cache[index].dirty = false;
+  cache[index].meta = false;
   cache[index].block = NULL;
   cache[index].sector = -1;
   cache[index].rw_count = 0;
@@ -53,6 +70,125 @@ cache_init (void)
     }
 }
 
+static int
+_cache_slot_cmp (const void *a_, const void *b_)
+{
+  const struct cache_slot *a = &cache[*(const uint32_t *) a_];
+  const struct cache_slot *b = &cache[*(const uint32_t *) b_];
+  if (a->block != b->block)
+    return a->block < b->block ? -1 : 1;
+  if (a->sector != b->sector)
+    return a->sector < b->sector ? -1 : 1;
+  return 0;
+}
+
+/* Writes back the CNT dirty slots in SLOTS and marks them clean.
+   The caller must hold their cs_locks, with nobody reading or
+   writing them.  Sorts the slots into disk order.  Writes each run
+   of adjacent data sectors with one request, submitting every run
+   before waiting for any.  Only once that data is on disk does it
+   commit the metadata sectors among them to the journal, as a
+   single transaction, so that committed metadata never points to
+   data that was not written.  Slots holding metadata must only be
+   passed when no file system operation is in progress. */
+static void
+_cache_write_back (uint32_t *slots, size_t cnt)
+{
+  block_sector_t meta_sectors[CACHE_SIZE];
+  const void *meta_images[CACHE_SIZE];
+  struct block_request *reqs;
+  uint8_t *staging;
+  size_t i, j, req_cnt = 0, meta_cnt = 0;
+
+  if (cnt == 0)
+    return;
+  qsort (slots, cnt, sizeof *slots, _cache_slot_cmp);
+
+  staging = malloc (cnt * BLOCK_SECTOR_SIZE);
+  reqs = malloc (cnt * sizeof *reqs);
+  for (i = 0; i < cnt; i = j)
+    {
+      struct cache_slot *first = &cache[slots[i]];
+      if (first->meta)
+	{
+	  meta_sectors[meta_cnt] = first->sector;
+	  meta_images[meta_cnt++] = first->data;
+	  j = i + 1;
+	}
+      else if (staging == NULL || reqs == NULL)
+	{
+	  /* Out of memory: fall back to a write per slot. */
+	  block_write (first->block, first->sector, first->data);
+	  j = i + 1;
+	}
+      else
+	{
+	  for (j = i; j < cnt; j++)
+	    {
+	      struct cache_slot *s = &cache[slots[j]];
+	      if (s->meta || s->block != first->block
+		  || s->sector != first->sector + (j - i))
+		break;
+	      memcpy (staging + j * BLOCK_SECTOR_SIZE, s->data,
+		      BLOCK_SECTOR_SIZE);
+	    }
+	  block_request_init (&reqs[req_cnt], true, first->sector, j - i,
+			      staging + i * BLOCK_SECTOR_SIZE, NULL, NULL);
+	  block_submit (first->block, &reqs[req_cnt++]);
+	}
+    }
+  for (i = 0; i < req_cnt; i++)
+    block_wait (&reqs[i]);
+  if (meta_cnt > 0)
+    journal_commit (meta_sectors, meta_images, meta_cnt);
+  free (staging);
+  free (reqs);
+
+  for (i = 0; i < cnt; i++)
+    cache[slots[i]].dirty = false;
+}
+
+/* Returns the index of the slot caching SECTOR of BLOCK, or -1. */
+static int
+_cache_lookup (struct block *block, block_sector_t sector)
+{
+  int i;
+  for (i = 0; i < CACHE_SIZE; ++i)
+    if (cache[i].block == block && cache[i].sector == sector)
+      return i;
+  return -1;
+}
+
+/* Adds to SLOTS, starting at *CNT, up to EVICT_CLUSTER dirty slots
+   that continue SECTOR of BLOCK on disk in direction STEP (1 or
+   -1) and can be locked without waiting. */
+static void
+_cache_gather_cluster (struct block *block, block_sector_t sector, int step,
+		       uint32_t *slots, size_t *cnt)
+{
+  int n;
+  for (n = 1; n <= EVICT_CLUSTER; n++)
+    {
+      int i = _cache_lookup (block, sector + n * step);
+      if (i < 0 || !cache[i].dirty || !lock_try_acquire (&cache[i].cs_lock))
+	return;
+      if (cache[i].rw_count != 0 || !cache[i].dirty || cache[i].meta)
+	{
+	  lock_release (&cache[i].cs_lock);
+	  return;
+	}
+      slots[(*cnt)++] = i;
+    }
+}
+
+/* Returns true if slot I holds metadata not yet committed, which
+   must stay in the cache until cache_sync() commits it. */
+static bool
+_cache_pinned (uint32_t i)
+{
+  return cache[i].dirty && cache[i].meta;
+}
+
 static uint32_t
 _cache_evict (void)
 {
@@ -64,16 +200,35 @@ _cache_evict (void)
 	clock_hand = 0;
       if (cache[clock_hand].accessed) 
 	cache[clock_hand].accessed = false;
-      else
+      else if (!_cache_pinned (clock_hand))
 	{
 	  lock_acquire (&cache[clock_hand].cs_lock);
 	  while (cache[clock_hand].rw_count != 0)
 	    cond_wait (&cache[clock_hand].no_rw_cond, 
 		       &cache[clock_hand].cs_lock);
+	  if (_cache_pinned (clock_hand))
+	    {
+	      lock_release (&cache[clock_hand].cs_lock);
+	      continue;
+	    }
 	  if (cache[clock_hand].dirty)
-	    block_write (cache[clock_hand].block,
-			 cache[clock_hand].sector,
-			 cache[clock_hand].data);
+	    {
+	      /* Write back the victim's dirty neighbours along with
+		 it, so that they go out in the same request. */
+	      uint32_t slots[CACHE_SIZE];
+	      size_t cnt = 0, i;
+	      slots[cnt++] = clock_hand;
+	      _cache_gather_cluster (cache[clock_hand].block,
+				     cache[clock_hand].sector, -1,
+				     slots, &cnt);
+	      _cache_gather_cluster (cache[clock_hand].block,
+				     cache[clock_hand].sector, 1,
+				     slots, &cnt);
+	      _cache_write_back (slots, cnt);
+	      for (i = 0; i < cnt; i++)
+		if (slots[i] != clock_hand)
+		  lock_release (&cache[slots[i]].cs_lock);
+	    }
 	  lock_release (&cache[clock_hand].cs_lock);
 	  _cache_slot_init (clock_hand);
 	  return clock_hand;
@@ -116,16 +271,20 @@ _cache_find_ensured (struct block *block, block_sector_t sector)
   return index;
 }
 
+/* Writes SIZE bytes from BUFFER into the cached copy of SECTOR of
+   BLOCK, starting at OFFSET.  META marks the sector as file
+   system metadata, which is written back through the journal. */
 void 
 cache_write (struct block *block, block_sector_t sector, 
 	     const void *buffer, off_t offset, off_t size,
-             struct inode_disk *disk_inode) 
+             struct inode_disk *disk_inode, bool meta) 
 {
   uint32_t index = _cache_find_ensured (block, sector);
   cache[index].rw_count++;
   lock_release (&cache[index].cs_lock);
   
   cache[index].dirty = true;
+  cache[index].meta = meta;
   cache[index].accessed = true;
   cache[index].disk_inode = disk_inode;
   memcpy (&cache[index].data[offset], buffer, size);
@@ -157,40 +316,158 @@ cache_read (struct block *block, block_sector_t sector,
   lock_release (&cache[index].cs_lock);
 }
 
+/* Locks slot I and waits until nobody is reading or writing it. */
+static void
+_cache_lock_idle (int i)
+{
+  lock_acquire (&cache[i].cs_lock);
+  while (cache[i].rw_count != 0)
+    cond_wait (&cache[i].no_rw_cond, &cache[i].cs_lock);
+}
+
+/* Writes back and drops the data slots of DISK_INODE.  Its
+   metadata slots stay in the cache until cache_sync() commits
+   them, no longer tied to DISK_INODE. */
 void 
 cache_flush (struct inode_disk *disk_inode)
 {
-  /* iterate through all cache slots and flush */
+  /* Lock the slots of DISK_INODE in index order, keeping the
+     dirty ones locked so that they can be written back
+     together. */
+  uint32_t slots[CACHE_SIZE];
+  size_t cnt = 0, j;
   int i;
   for (i = 0; i < CACHE_SIZE; ++i) 
     {
-      if (cache[i].disk_inode == disk_inode)
-        {
-          lock_acquire (&cache[i].cs_lock);
-          while (cache[i].rw_count != 0)
-            cond_wait (&cache[i].no_rw_cond, 
-                       &cache[i].cs_lock);
-	  block_write (cache[i].block,
-		       cache[i].sector,
-		       cache[i].data);
-          lock_release (&cache[i].cs_lock);
-          _cache_slot_init (i);
-        }
+      if (cache[i].disk_inode != disk_inode)
+	continue;
+      _cache_lock_idle (i);
+      if (cache[i].disk_inode != disk_inode)
+	lock_release (&cache[i].cs_lock);
+      else if (_cache_pinned (i))
+	{
+	  cache[i].disk_inode = NULL;
+	  lock_release (&cache[i].cs_lock);
+	}
+      else if (cache[i].dirty)
+	slots[cnt++] = i;
+      else
+	{
+	  _cache_slot_init (i);
+	  lock_release (&cache[i].cs_lock);
+	}
+    }
+  _cache_write_back (slots, cnt);
+  for (j = 0; j < cnt; j++)
+    {
+      _cache_slot_init (slots[j]);
+      lock_release (&cache[slots[j]].cs_lock);
+    }
+}
+
+/* Returns the number of slots holding metadata not yet
+   committed. */
+size_t
+cache_dirty_meta_cnt (void)
+{
+  size_t cnt = 0;
+  int i;
+  for (i = 0; i < CACHE_SIZE; ++i)
+    if (_cache_pinned (i))
+      cnt++;
+  return cnt;
+}
+
+/* Returns true if slot I holds file data that some metadata not
+   yet committed may point to: data of an inode that has
+   uncommitted metadata in the cache. */
+static bool
+_cache_data_of_pinned (uint32_t i)
+{
+  int j;
+  for (j = 0; j < CACHE_SIZE; ++j)
+    if (_cache_pinned (j) && cache[j].disk_inode == cache[i].disk_inode)
+      return true;
+  return false;
+}
+
+/* Returns true if a sync of DISK_INODE, or of every inode if ALL
+   is true, must write back slot I. */
+static bool
+_cache_sync_needs (uint32_t i, struct inode_disk *disk_inode, bool all)
+{
+  return (all || cache[i].meta || cache[i].disk_inode == disk_inode
+	  || _cache_data_of_pinned (i));
+}
+
+/* Writes back the dirty slots that a sync of DISK_INODE, or of
+   every inode if ALL is true, needs: the file data first, then
+   all the metadata as one transaction.  Waits for file system
+   operations in progress to end first, so that the transaction
+   holds only whole operations.  Unlike cache_flush(), the slots
+   stay cached, now clean. */
+static void
+_cache_sync (struct inode_disk *disk_inode, bool all)
+{
+  uint32_t slots[CACHE_SIZE];
+  size_t cnt = 0, j;
+  int i;
+
+  journal_quiesce ();
+  for (i = 0; i < CACHE_SIZE; ++i)
+    {
+      if (!cache[i].dirty || !_cache_sync_needs (i, disk_inode, all))
+	continue;
+      _cache_lock_idle (i);
+      if (cache[i].dirty)
+	slots[cnt++] = i;
+      else
+	lock_release (&cache[i].cs_lock);
     }
+  _cache_write_back (slots, cnt);
+  for (j = 0; j < cnt; j++)
+    lock_release (&cache[slots[j]].cs_lock);
+  journal_resume ();
+}
+
+/* Writes back every dirty slot. */
+void
+cache_sync (void)
+{
+  _cache_sync (NULL, true);
+}
+
+/* Writes back the dirty data slots of DISK_INODE and all the
+   metadata not yet committed.  Metadata sectors such as the free
+   map and directories are shared by many operations, so a
+   transaction can only hold whole operations if it commits all
+   of them; the data of other inodes with metadata in that
+   transaction goes first, so that committed metadata never
+   points to data that was not written.  Other data stays
+   dirty in the cache. */
+void
+cache_sync_inode (struct inode_disk *disk_inode)
+{
+  _cache_sync (disk_inode, false);
 }
 
 void 
 cache_flush_all (void)
 { 
+  uint32_t slots[CACHE_SIZE];
+  size_t cnt = 0, j;
   int i;
   for (i = 0; i < CACHE_SIZE; ++i)
     {
-      lock_acquire (&cache[i].cs_lock);
-      block_write (cache[i].block,
-		   cache[i].sector,
-		   cache[i].data);
-      lock_release (&cache[i].cs_lock);
-      _cache_slot_init (i);        
+      _cache_lock_idle (i);
+      if (cache[i].dirty)
+	slots[cnt++] = i;
+      else
+	lock_release (&cache[i].cs_lock);
     }
+  _cache_write_back (slots, cnt);
+  for (j = 0; j < cnt; j++)
+    lock_release (&cache[slots[j]].cs_lock);
+  for (i = 0; i < CACHE_SIZE; ++i)
+    _cache_slot_init (i);
 }
-
@@ -1,6 +1,7 @@
 #ifndef FILESYS_CACHE_H
 #define FILESYS_CACHE_H
 
+#include <stddef.h>
 #include "devices/block.h"
 #include "filesys/off_t.h"
 #include "filesys/inode.h"
@@ -8,9 +9,12 @@
 void cache_read (struct block *, block_sector_t, void *, 
 		 off_t, off_t, struct inode_disk *);
 void cache_write (struct block *, block_sector_t, const void *,
-		  off_t, off_t, struct inode_disk *);
+		  off_t, off_t, struct inode_disk *, bool meta);
 void cache_flush (struct inode_disk *);
 void cache_flush_all (void);
+void cache_sync (void);
+void cache_sync_inode (struct inode_disk *);
+size_t cache_dirty_meta_cnt (void);
 void cache_init (void);
 
 #endif /* filesys/cache.h */
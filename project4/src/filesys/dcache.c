@@ -0,0 +1,206 @@
+#include "filesys/dcache.h"
+#include <debug.h>
+#include <hash.h>
+#include <list.h>
+#include <string.h>
+#include "filesys/directory.h"
+#include "threads/malloc.h"
+#include "threads/synch.h"
+
+/* Maximum number of names kept in the cache. */
+#define DCACHE_SIZE 128
+
+/* A cached directory entry: NAME in the directory whose inode
+   is at PARENT resolves to SECTOR, or to DCACHE_NEGATIVE if NAME
+   is known not to exist there. */
+struct dcache_entry
+  {
+    struct hash_elem hash_elem;         /* Element in dcache_table. */
+    struct list_elem lru_elem;          /* Element in dcache_lru. */
+    block_sector_t parent;              /* Parent directory sector. */
+    block_sector_t sector;              /* Inode sector or DCACHE_NEGATIVE. */
+    const char *name;                   /* NAME_BUF, or caller's string
+                                           in a search key. */
+    char name_buf[];                    /* Null terminated file name. */
+  };
+
+static struct lock dcache_lock;
+static struct hash dcache_table;
+static struct list dcache_lru;          /* Most recently used at front. */
+
+/* Incremented by every dcache_insert() and dcache_invalidate(),
+   that is, whenever a directory changes, so that a search that
+   overlapped a change does not cache a stale result. */
+static unsigned dcache_gen;
+
+static unsigned
+dcache_hash (const struct hash_elem *e, void *aux UNUSED)
+{
+  const struct dcache_entry *de = hash_entry (e, struct dcache_entry,
+                                              hash_elem);
+  return hash_string (de->name) ^ hash_int (de->parent);
+}
+
+static bool
+dcache_less (const struct hash_elem *a_, const struct hash_elem *b_,
+             void *aux UNUSED)
+{
+  const struct dcache_entry *a = hash_entry (a_, struct dcache_entry,
+                                             hash_elem);
+  const struct dcache_entry *b = hash_entry (b_, struct dcache_entry,
+                                             hash_elem);
+  if (a->parent != b->parent)
+    return a->parent < b->parent;
+  return strcmp (a->name, b->name) < 0;
+}
+
+void
+dcache_init (void)
+{
+  lock_init (&dcache_lock);
+  list_init (&dcache_lru);
+  if (!hash_init (&dcache_table, dcache_hash, dcache_less, NULL))
+    PANIC ("dcache creation failed");
+}
+
+/* Returns the cached entry for NAME in PARENT, or a null pointer.
+   Must be called with dcache_lock held. */
+static struct dcache_entry *
+_dcache_find (block_sector_t parent, const char *name)
+{
+  struct dcache_entry key;
+  struct hash_elem *e;
+
+  key.parent = parent;
+  key.name = name;
+  e = hash_find (&dcache_table, &key.hash_elem);
+  return e != NULL ? hash_entry (e, struct dcache_entry, hash_elem) : NULL;
+}
+
+/* Looks up NAME in the directory at PARENT.  Returns true if the
+   cache knows the answer, storing the inode sector (or
+   DCACHE_NEGATIVE if NAME does not exist) in *SECTORP.  Returns
+   false if the directory itself must be searched. */
+bool
+dcache_lookup (block_sector_t parent, const char *name,
+               block_sector_t *sectorp)
+{
+  struct dcache_entry *de;
+
+  lock_acquire (&dcache_lock);
+  de = _dcache_find (parent, name);
+  if (de != NULL)
+    {
+      list_remove (&de->lru_elem);
+      list_push_front (&dcache_lru, &de->lru_elem);
+      *sectorp = de->sector;
+    }
+  lock_release (&dcache_lock);
+  return de != NULL;
+}
+
+/* Records that NAME in the directory at PARENT resolves to
+   SECTOR, which may be DCACHE_NEGATIVE.  Replaces any previous
+   entry and evicts the least recently used one if full.
+   Must be called with dcache_lock held. */
+static void
+_dcache_insert (block_sector_t parent, const char *name,
+                block_sector_t sector)
+{
+  struct dcache_entry *de;
+  size_t len = strlen (name);
+
+  if (len > NAME_MAX)
+    return;
+
+  de = _dcache_find (parent, name);
+  if (de != NULL)
+    {
+      /* Already cached: just update it in place. */
+      list_remove (&de->lru_elem);
+      de->sector = sector;
+      list_push_front (&dcache_lru, &de->lru_elem);
+      return;
+    }
+
+  if (hash_size (&dcache_table) >= DCACHE_SIZE)
+    {
+      /* Drop the least recently used entry. */
+      de = list_entry (list_back (&dcache_lru), struct dcache_entry,
+                       lru_elem);
+      list_remove (&de->lru_elem);
+      hash_delete (&dcache_table, &de->hash_elem);
+      free (de);
+    }
+
+  de = malloc (sizeof *de + len + 1);
+  if (de == NULL)
+    return;
+  de->parent = parent;
+  de->sector = sector;
+  strlcpy (de->name_buf, name, len + 1);
+  de->name = de->name_buf;
+  hash_insert (&dcache_table, &de->hash_elem);
+  list_push_front (&dcache_lru, &de->lru_elem);
+}
+
+/* Records that NAME in the directory at PARENT now resolves to
+   SECTOR, which may be DCACHE_NEGATIVE.  For use by code that
+   has just changed the directory on disk. */
+void
+dcache_insert (block_sector_t parent, const char *name,
+               block_sector_t sector)
+{
+  lock_acquire (&dcache_lock);
+  dcache_gen++;
+  _dcache_insert (parent, name, sector);
+  lock_release (&dcache_lock);
+}
+
+/* Returns the current generation, to be passed to dcache_fill()
+   after searching a directory.  Must be read before the search
+   starts. */
+unsigned
+dcache_generation (void)
+{
+  unsigned gen;
+
+  lock_acquire (&dcache_lock);
+  gen = dcache_gen;
+  lock_release (&dcache_lock);
+  return gen;
+}
+
+/* Records SECTOR, the result of searching the directory at
+   PARENT for NAME, unless some directory changed since
+   dcache_generation() returned GENERATION: the search may then
+   have raced with the change and seen the directory as it was
+   before. */
+void
+dcache_fill (block_sector_t parent, const char *name,
+             block_sector_t sector, unsigned generation)
+{
+  lock_acquire (&dcache_lock);
+  if (dcache_gen == generation)
+    _dcache_insert (parent, name, sector);
+  lock_release (&dcache_lock);
+}
+
+/* Forgets anything cached about NAME in the directory at
+   PARENT. */
+void
+dcache_invalidate (block_sector_t parent, const char *name)
+{
+  struct dcache_entry *de;
+
+  lock_acquire (&dcache_lock);
+  dcache_gen++;
+  de = _dcache_find (parent, name);
+  if (de != NULL)
+    {
+      list_remove (&de->lru_elem);
+      hash_delete (&dcache_table, &de->hash_elem);
+      free (de);
+    }
+  lock_release (&dcache_lock);
+}
@@ -0,0 +1,21 @@
+#ifndef FILESYS_DCACHE_H
+#define FILESYS_DCACHE_H
+
+#include <stdbool.h>
+#include "devices/block.h"
+
+/* Sector recorded for a negative entry, i.e. a name known not to
+   exist in its parent directory. */
+#define DCACHE_NEGATIVE ((block_sector_t) -1)
+
+void dcache_init (void);
+bool dcache_lookup (block_sector_t parent, const char *name,
+                    block_sector_t *sectorp);
+void dcache_insert (block_sector_t parent, const char *name,
+                    block_sector_t sector);
+unsigned dcache_generation (void);
+void dcache_fill (block_sector_t parent, const char *name,
+                  block_sector_t sector, unsigned generation);
+void dcache_invalidate (block_sector_t parent, const char *name);
+
+#endif /* filesys/dcache.h */
@@ -1,19 +1,78 @@
 #include "filesys/directory.h"
+#include <round.h>
 #include <stdio.h>
 #include <string.h>
 #include <list.h>
+#include "filesys/dcache.h"
 #include "filesys/filesys.h"
 #include "filesys/inode.h"
 #include <user/syscall.h>
 #include "threads/malloc.h"
 #include "threads/thread.h"
 
-/* Creates a directory with space for ENTRY_CNT entries in the
-   given SECTOR.  Returns true if successful, false on failure. */
+/* Returns the number of bytes taken by a directory entry whose
+   name is NAME_LEN bytes long, padded so that every entry header
+   stays 4-byte aligned. */
+static size_t
+rec_size (size_t name_len)
+{
+  return ROUND_UP (sizeof (struct dir_entry) + name_len, 4);
+}
+
+/* Returns the entry at byte offset OFS within SECTOR, a
+   directory sector read into memory. */
+static struct dir_entry *
+entry_at (uint8_t sector[BLOCK_SECTOR_SIZE], size_t ofs)
+{
+  return (struct dir_entry *) (sector + ofs);
+}
+
+/* Returns the number of bytes from the entry at OFS in SECTOR to
+   the next entry.  A zero or out-of-range length, as found in a
+   freshly zeroed sector, means the entry runs to the end of the
+   sector. */
+static size_t
+rec_len (uint8_t sector[BLOCK_SECTOR_SIZE], size_t ofs)
+{
+  const struct dir_entry *e = entry_at (sector, ofs);
+  if (e->rec_len < sizeof *e || ofs + e->rec_len > BLOCK_SECTOR_SIZE)
+    return BLOCK_SECTOR_SIZE - ofs;
+  return e->rec_len;
+}
+
+/* Iterates OFS over the entry offsets within SECTOR. */
+#define for_each_entry(OFS, SECTOR)                                 \
+  for ((OFS) = 0; (OFS) + sizeof (struct dir_entry) <= BLOCK_SECTOR_SIZE; \
+       (OFS) += rec_len ((SECTOR), (OFS)))
+
+/* Reads the directory sector at byte offset OFS within INODE
+   into SECTOR.  Returns false at end of file. */
+static bool
+read_dir_sector (struct inode *inode, off_t ofs,
+                 uint8_t sector[BLOCK_SECTOR_SIZE])
+{
+  return inode_read_at (inode, sector, BLOCK_SECTOR_SIZE, ofs)
+         == BLOCK_SECTOR_SIZE;
+}
+
+/* Returns true if E is in use and holds NAME, which is LEN bytes
+   long. */
+static bool
+entry_matches (const struct dir_entry *e, const char *name, size_t len)
+{
+  return ((e->flags & DIR_ENTRY_IN_USE)
+          && e->name_len == len && !memcmp (e->name, name, len));
+}
+
+/* Creates a directory in the given SECTOR with room for at least
+   ENTRY_CNT entry headers, rounded up to whole sectors.  The
+   directory grows a sector at a time as entries are added.
+   Returns true if successful, false on failure. */
 bool
 dir_create (block_sector_t sector, size_t entry_cnt)
 {
-  if(inode_create (sector, entry_cnt * sizeof (struct dir_entry)))
+  if(inode_create (sector, ROUND_UP (entry_cnt * sizeof (struct dir_entry),
+                                     BLOCK_SECTOR_SIZE), true))
     {
       struct inode *inode = inode_open (sector);
       inode_set_is_dir (inode);
@@ -53,6 +112,16 @@ dir_open_root (void)
   return dir_open (inode_open (ROOT_DIR_SECTOR));
 }
 
+/* Opens and returns a new directory for the running thread's
+   current working directory, or for the root directory if the
+   thread has none. */
+struct dir *
+dir_open_cwd (void)
+{
+  struct dir *cwd = thread_current ()->cwd;
+  return cwd != NULL ? dir_reopen (cwd) : dir_open_root ();
+}
+
 /* Opens and returns a new directory for the same inode as DIR.
    Returns a null pointer on failure. */
 struct dir *
@@ -90,29 +159,35 @@ static bool
 lookup (const struct dir *dir, const char *name,
         struct dir_entry *ep, off_t *ofsp) 
 {
-  struct dir_entry e;
-  size_t ofs;
+  uint8_t sector[BLOCK_SECTOR_SIZE];
+  size_t len, ofs;
+  off_t sector_ofs;
   
   ASSERT (dir != NULL);
   ASSERT (name != NULL);
 
-  for (ofs = 0; inode_read_at (dir->inode, &e, sizeof e, ofs) == sizeof e;
-       ofs += sizeof e) 
-    {
-      if (e.in_use && !strcmp (name, e.name)) 
-	{
-	  if (ep != NULL)
-	    *ep = e;
-	  if (ofsp != NULL)
-	    *ofsp = ofs;
-	  return true;
-	}
-    }
+  len = strlen (name);
+  for (sector_ofs = 0; read_dir_sector (dir->inode, sector_ofs, sector);
+       sector_ofs += BLOCK_SECTOR_SIZE)
+    for_each_entry (ofs, sector)
+      {
+        struct dir_entry *e = entry_at (sector, ofs);
+        if (entry_matches (e, name, len))
+          {
+            if (ep != NULL)
+              *ep = *e;
+            if (ofsp != NULL)
+              *ofsp = sector_ofs + ofs;
+            return true;
+          }
+      }
   return false;
 }
 
 /* Searches DIR for a file with the given NAME
    and returns true if one exists, false otherwise.
+   "." and ".." are resolved from DIR's own inode without
+   searching.  Nothing can be found in a removed directory.
    On success, sets *INODE to an inode for the file, otherwise to
    a null pointer.  The caller must close *INODE. */
 bool
@@ -120,12 +195,38 @@ dir_lookup (const struct dir *dir, const char *name,
             struct inode **inode) 
 {
   struct dir_entry e;
+  block_sector_t parent, sector;
+  unsigned gen;
 
   ASSERT (dir != NULL);
   ASSERT (name != NULL);
 
-  if (lookup (dir, name, &e, NULL))
-    *inode = inode_open (e.inode_sector);
+  if (inode_is_removed (dir->inode))
+    {
+      *inode = NULL;
+      return false;
+    }
+  if (!strcmp (name, "."))
+    {
+      *inode = inode_reopen (dir->inode);
+      return true;
+    }
+  if (!strcmp (name, ".."))
+    {
+      *inode = inode_open (inode_get_parent_dir_sector (dir->inode));
+      return *inode != NULL;
+    }
+
+  parent = inode_get_inumber (dir->inode);
+  if (!dcache_lookup (parent, name, &sector))
+    {
+      gen = dcache_generation ();
+      sector = lookup (dir, name, &e, NULL) ? e.inode_sector : DCACHE_NEGATIVE;
+      dcache_fill (parent, name, sector, gen);
+    }
+
+  if (sector != DCACHE_NEGATIVE)
+    *inode = inode_open (sector);
   else
     *inode = NULL;
 
@@ -142,44 +243,88 @@ bool
 dir_add (struct dir *dir, const char *name, 
          block_sector_t inode_sector)
 {
-  struct dir_entry e;
-  off_t ofs;
+  uint8_t sector[BLOCK_SECTOR_SIZE];
+  struct dir_entry *e;
+  size_t len, need, ofs = 0, avail;
+  off_t sector_ofs;
+  bool found = false;
   bool success = false;
 
   ASSERT (dir != NULL);
   ASSERT (name != NULL);
 
   /* Check NAME for validity. */
-  if (*name == '\0' || strlen (name) > NAME_MAX)
+  len = strlen (name);
+  if (len == 0 || len > NAME_MAX
+      || !strcmp (name, ".") || !strcmp (name, ".."))
     return false;
 
   /* Check that NAME is not in use. */
   if (lookup (dir, name, NULL, NULL))
     goto done;
 
-  /* Set OFS to offset of free slot.
-     If there are no free slots, then it will be set to the
-     current end-of-file.
+  /* Find an entry with enough room after its name (or a free
+     entry big enough) to hold the new one.  If there is none,
+     SECTOR_OFS ends up at end of file and we append a new
+     sector.
      
      inode_read_at() will only return a short read at end of file.
      Otherwise, we'd need to verify that we didn't get a short
      read due to something intermittent such as low memory. */
-  for (ofs = 0; inode_read_at (dir->inode, &e, sizeof e, ofs) == sizeof e;
-       ofs += sizeof e) 
-    if (!e.in_use)
-      break;
-
-  /* Write slot. */
-  e.in_use = true;
-  strlcpy (e.name, name, sizeof e.name);
-  e.inode_sector = inode_sector;
+  need = rec_size (len);
+  for (sector_ofs = 0; read_dir_sector (dir->inode, sector_ofs, sector);
+       sector_ofs += BLOCK_SECTOR_SIZE)
+    {
+      for_each_entry (ofs, sector)
+        {
+          e = entry_at (sector, ofs);
+          avail = rec_len (sector, ofs);
+          if (e->flags & DIR_ENTRY_IN_USE)
+            avail -= rec_size (e->name_len);
+          if (avail >= need)
+            {
+              found = true;
+              break;
+            }
+        }
+      if (found)
+        break;
+    }
+  if (!found)
+    {
+      memset (sector, 0, sizeof sector);
+      ofs = 0;
+    }
 
+  /* Split the space off the end of an in-use entry, or take over
+     a free one, and write the new entry there. */
+  e = entry_at (sector, ofs);
+  avail = rec_len (sector, ofs);
+  if (e->flags & DIR_ENTRY_IN_USE)
+    {
+      size_t used = rec_size (e->name_len);
+      e->rec_len = used;
+      ofs += used;
+      avail -= used;
+      e = entry_at (sector, ofs);
+    }
   /* update parent sector */
   struct inode *child = inode_open (inode_sector);
   inode_set_parent_dir_sector (child, inode_get_inumber (dir->inode));
+
+  e->inode_sector = inode_sector;
+  e->rec_len = avail;
+  e->name_len = len;
+  e->flags = DIR_ENTRY_IN_USE | (inode_is_dir (child) ? DIR_ENTRY_IS_DIR : 0);
+  memcpy (e->name, name, len);
   inode_close (child);
  
-  success = inode_write_at (dir->inode, &e, sizeof e, ofs) == sizeof e;
+  success = inode_write_at (dir->inode, sector, BLOCK_SECTOR_SIZE,
+                            sector_ofs) == BLOCK_SECTOR_SIZE;
+  if (success)
+    dcache_insert (inode_get_inumber (dir->inode), name, inode_sector);
+  else
+    dcache_invalidate (inode_get_inumber (dir->inode), name);
 
  done:
   return success;
@@ -191,27 +336,52 @@ dir_add (struct dir *dir, const char *name,
 bool
 dir_remove (struct dir *dir, const char *name) 
 {
-  struct dir_entry e;
+  uint8_t sector[BLOCK_SECTOR_SIZE];
+  struct dir_entry *e;
   struct inode *inode = NULL;
   bool success = false;
-  off_t ofs;
+  off_t ofs, sector_ofs;
+  size_t prev_ofs, cur_ofs;
 
   ASSERT (dir != NULL);
   ASSERT (name != NULL);
 
-  /* Find directory entry. */
-  if (!lookup (dir, name, &e, &ofs))
+  /* Find directory entry and read in its sector. */
+  if (!lookup (dir, name, NULL, &ofs))
+    goto done;
+  sector_ofs = ofs - ofs % BLOCK_SECTOR_SIZE;
+  if (!read_dir_sector (dir->inode, sector_ofs, sector))
     goto done;
+  e = entry_at (sector, ofs % BLOCK_SECTOR_SIZE);
 
   /* Open inode. */
-  inode = inode_open (e.inode_sector);
+  inode = inode_open (e->inode_sector);
   if (inode == NULL)
     goto done;
 
-  /* Erase directory entry. */
-  e.in_use = false;
-  if (inode_write_at (dir->inode, &e, sizeof e, ofs) != sizeof e) 
+  /* Erase directory entry, merging its space into the previous
+     entry in the sector if there is one.  The erased header is
+     left behind marked free so that a readdir position pointing
+     at it still finds the next entry. */
+  prev_ofs = BLOCK_SECTOR_SIZE;
+  for_each_entry (cur_ofs, sector)
+    {
+      if (cur_ofs == (size_t) (ofs - sector_ofs))
+        break;
+      prev_ofs = cur_ofs;
+    }
+  e->rec_len = rec_len (sector, ofs - sector_ofs);
+  e->flags = 0;
+  e->name_len = 0;
+  if (prev_ofs != BLOCK_SECTOR_SIZE)
+    entry_at (sector, prev_ofs)->rec_len = rec_len (sector, prev_ofs)
+                                           + e->rec_len;
+
+  dcache_invalidate (inode_get_inumber (dir->inode), name);
+  if (inode_write_at (dir->inode, sector, BLOCK_SECTOR_SIZE, sector_ofs)
+      != BLOCK_SECTOR_SIZE)
     goto done;
+  dcache_insert (inode_get_inumber (dir->inode), name, DCACHE_NEGATIVE);
 
   /* Remove inode. */
   inode_remove (inode);
@@ -228,20 +398,76 @@ dir_remove (struct dir *dir, const char *name)
 bool
 dir_readdir (struct dir *dir, char name[NAME_MAX + 1])
 {
-  struct dir_entry e;
+  uint8_t sector[BLOCK_SECTOR_SIZE];
+  off_t sector_ofs;
+  size_t ofs;
 
-  while (inode_read_at (dir->inode, &e, sizeof e, dir->pos) == sizeof e) 
-    {
-      dir->pos += sizeof e;
-      if (e.in_use)
-        {
-          strlcpy (name, e.name, NAME_MAX + 1);
-          return true;
-        } 
-    }
+  for (sector_ofs = dir->pos - dir->pos % BLOCK_SECTOR_SIZE;
+       read_dir_sector (dir->inode, sector_ofs, sector);
+       sector_ofs += BLOCK_SECTOR_SIZE)
+    for_each_entry (ofs, sector)
+      {
+        struct dir_entry *e = entry_at (sector, ofs);
+
+        /* Skip entries already returned.  We walk from the start
+           of the sector because an entry boundary at DIR->POS may
+           have been merged away since the last call. */
+        if (sector_ofs + (off_t) ofs < dir->pos
+            || !(e->flags & DIR_ENTRY_IN_USE))
+          continue;
+        memcpy (name, e->name, e->name_len);
+        name[e->name_len] = '\0';
+        dir->pos = sector_ofs + ofs + rec_len (sector, ofs);
+        return true;
+      }
+  dir->pos = sector_ofs;
   return false;
 }
 
+/* Copies as many of DIR's remaining entries as fit into the SIZE
+   bytes at BUFFER, packed as struct readdir_entry records, and
+   advances DIR's position past them.  Returns the number of bytes
+   written, 0 if the directory contains no more entries, or -1 if
+   SIZE is too small to hold even the next entry. */
+int
+dir_readdir_batch (struct dir *dir, void *buffer, size_t size)
+{
+  uint8_t sector[BLOCK_SECTOR_SIZE];
+  uint8_t *out = buffer;
+  size_t used = 0;
+  off_t sector_ofs;
+  size_t ofs;
+
+  for (sector_ofs = dir->pos - dir->pos % BLOCK_SECTOR_SIZE;
+       read_dir_sector (dir->inode, sector_ofs, sector);
+       sector_ofs += BLOCK_SECTOR_SIZE)
+    for_each_entry (ofs, sector)
+      {
+        struct dir_entry *e = entry_at (sector, ofs);
+        struct readdir_entry *re;
+        size_t re_len;
+
+        if (sector_ofs + (off_t) ofs < dir->pos
+            || !(e->flags & DIR_ENTRY_IN_USE))
+          continue;
+        re_len = ROUND_UP (offsetof (struct readdir_entry, name)
+                           + e->name_len + 1, 4);
+        if (used + re_len > size)
+          return used > 0 ? (int) used : -1;
+
+        re = (struct readdir_entry *) (out + used);
+        re->inumber = e->inode_sector;
+        re->rec_len = re_len;
+        re->is_dir = (e->flags & DIR_ENTRY_IS_DIR) != 0;
+        memcpy (re->name, e->name, e->name_len);
+        re->name[e->name_len] = '\0';
+        used += re_len;
+        dir->pos = sector_ofs + ofs + rec_len (sector, ofs);
+      }
+  dir->pos = sector_ofs;
+  return used;
+}
+
 static size_t
 _strip_leading_spaces (const char *full_path, char *tokens, size_t len)
 {
@@ -306,9 +532,7 @@ dir_get_parent_dir (const char *full_path)
   if (tokens[0] == '/')
     curr_dir = dir_open_root ();
   else 
-    {
-      curr_dir = dir_open(inode_open (thread_current ()->cwd_sector));
-    }
+    curr_dir = dir_open_cwd ();
 
   if (new_len == 0)
     {
@@ -374,15 +598,15 @@ dir_get_parent_dir (const char *full_path)
 bool 
 dir_is_empty (struct inode *inode)
 {
-  struct dir *dir = dir_open (inode);
-  
-  struct dir_entry e;
+  uint8_t sector[BLOCK_SECTOR_SIZE];
+  off_t sector_ofs;
   size_t ofs;
 
-  for (ofs = 0; inode_read_at (dir->inode, &e, sizeof e, ofs) == sizeof e;
-       ofs += sizeof e)
-    if (e.in_use)
-      return false;
+  for (sector_ofs = 0; read_dir_sector (inode, sector_ofs, sector);
+       sector_ofs += BLOCK_SECTOR_SIZE)
+    for_each_entry (ofs, sector)
+      if (entry_at (sector, ofs)->flags & DIR_ENTRY_IN_USE)
+        return false;
   return true;
 }
 
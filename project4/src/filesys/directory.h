@@ -3,14 +3,13 @@
 
 #include <stdbool.h>
 #include <stddef.h>
+#include <stdint.h>
 #include "devices/block.h"
 #include "filesys/off_t.h"
 
 /* Maximum length of a file name component.
-   This is the traditional UNIX maximum length.
-   After directories are implemented, this maximum length may be
-   retained, but much longer full path names must be allowed. */
-#define NAME_MAX 14
+   Directory entries store the name's length in a single byte. */
+#define NAME_MAX 255
 
 struct inode;
 
@@ -21,19 +20,30 @@ struct dir
   off_t pos;                          /* Current position. */
 };
 
-/* A single directory entry. */
+/* A single directory entry.
+   Entries vary in length with their names and are packed into
+   directory sectors, never crossing a sector boundary.  REC_LEN
+   chains each entry to the next one in its sector; any bytes in
+   between past the name are free space for new entries. */
 struct dir_entry
 {
   block_sector_t inode_sector;        /* Sector number of header. */
-  char name[NAME_MAX + 1];            /* Null terminated file name. */
-  bool in_use;                        /* In use or free? */
+  uint16_t rec_len;                   /* Bytes to the next entry. */
+  uint8_t name_len;                   /* Length of NAME. */
+  uint8_t flags;                      /* DIR_ENTRY_* flags. */
+  char name[];                        /* File name, not null terminated. */
 };
 
+/* Directory entry flags. */
+#define DIR_ENTRY_IN_USE 0x01           /* In use or free? */
+#define DIR_ENTRY_IS_DIR 0x02           /* Names a directory? */
+
 
 /* Opening and closing directories. */
 bool dir_create (block_sector_t sector, size_t entry_cnt);
 struct dir *dir_open (struct inode *);
 struct dir *dir_open_root (void);
+struct dir *dir_open_cwd (void);
 struct dir *dir_reopen (struct dir *);
 void dir_close (struct dir *);
 struct inode *dir_get_inode (struct dir *);
@@ -43,6 +53,7 @@ bool dir_lookup (const struct dir *, const char *name, struct inode **);
 bool dir_add (struct dir *, const char *name, block_sector_t);
 bool dir_remove (struct dir *, const char *name);
 bool dir_readdir (struct dir *, char name[NAME_MAX + 1]);
+int dir_readdir_batch (struct dir *, void *buffer, size_t size);
 
 bool dir_get_leaf_name (const char *full_path, char *leaf_name);
 struct dir* dir_get_parent_dir (const char *full_path);
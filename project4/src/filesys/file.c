@@ -102,7 +102,7 @@ file_write (struct file *file, const void *buffer, off_t size)
     return -1;
   off_t bytes_written = inode_write_at (file->inode, buffer, size, file->pos);
   file->pos += bytes_written;
-  block_write (fs_device, file->inode->sector, &file->inode->data);
+  inode_save (file->inode);
   return bytes_written;
 }
 
@@ -118,7 +118,7 @@ file_write_at (struct file *file, const void *buffer, off_t size,
                off_t file_ofs) 
 {  
   off_t tmp = inode_write_at (file->inode, buffer, size, file_ofs);
-  block_write (fs_device, file->inode->sector, &file->inode->data);
+  inode_save (file->inode);
   return tmp;
 }
 
@@ -8,13 +8,21 @@
 #include "filesys/inode.h"
 #include "filesys/directory.h"
 #include "filesys/cache.h"
+#include "filesys/journal.h"
+#include "filesys/dcache.h"
 #include "threads/thread.h"
 #include "devices/block.h"
 
 /* Partition that contains the file system. */
 struct block *fs_device;
 
+/* If true, filesys_done() leaves the disk as it is, so that
+   tests can see what would survive a crash. */
+bool filesys_no_flush;
+
 static void do_format (void);
+static bool _filesys_remove (const char *name);
+static bool _filesys_grow (const char *name, off_t size);
 
 /* Initializes the file system module.
    If FORMAT is true, reformats the file system. */
@@ -28,6 +36,8 @@ filesys_init (bool format)
   inode_init ();
   free_map_init ();
   cache_init ();
+  dcache_init ();
+  journal_init (format);
 
   if (format) 
     do_format ();
@@ -36,7 +46,7 @@ filesys_init (bool format)
 
   /* Couldn't add to thread_init because we need inode_init completed
      before we can get access to root directory */
-  thread_current ()->cwd_sector = ROOT_DIR_SECTOR;
+  thread_current ()->cwd = dir_open_root ();
 }
 
 /* Shuts down the file system module, writing any unwritten data
@@ -44,6 +54,9 @@ filesys_init (bool format)
 void
 filesys_done (void) 
 {
+  if (filesys_no_flush)
+    return;
+  inode_save_all ();
   cache_flush_all ();
   free_map_close ();
 }
@@ -61,36 +74,15 @@ filesys_open (const char *name)
 
   if (strcmp (".", name) == 0)
     {
-      block_sector_t cwd = thread_current ()->cwd_sector;
-      struct inode *curr = NULL;
-      curr = inode_open (cwd);
-
-      struct dir *p;
-      p = dir_open (inode_open (curr->data.parent_dir_sector));
-      
-      struct dir_entry e;
-      size_t ofs;
-
-      ASSERT (p != NULL);
-
-      for (ofs = 0; 
-	   inode_read_at (p->inode, &e, sizeof e, ofs) == sizeof e;
-	   ofs += sizeof e)
-	{
-	  if (e.inode_sector == cwd && e.in_use)
-	    {
-	      return filesys_open (e.name); 
-	    }
-	}
-      return NULL;
+      struct dir *cwd = dir_open_cwd ();
+      struct inode *inode = NULL;
+      if (cwd != NULL && !inode_is_removed (dir_get_inode (cwd)))
+        inode = inode_reopen (dir_get_inode (cwd));
+      dir_close (cwd);
+      return file_open (inode);
     }
-  struct inode *crr = NULL;
-  crr = inode_open (thread_current ()->cwd_sector);
 
-  struct dir *parent_dir = dir_reopen(dir_get_parent_dir (name));
-  //if (crr->data.is_dir)
-  //parent_dir = dir_open (inode_open (crr->data.parent_dir_sector));
-  //else 
+  struct dir *parent_dir = dir_get_parent_dir (name);
   if (parent_dir == NULL)
     return NULL;
   
@@ -118,6 +110,18 @@ filesys_open (const char *name)
    or if an internal memory allocation fails. */
 bool
 filesys_remove (const char *name) 
+{
+  bool success;
+
+  journal_begin ();
+  success = _filesys_remove (name);
+  journal_end ();
+  return success;
+}
+
+/* Does the work of filesys_remove(). */
+static bool
+_filesys_remove (const char *name) 
 {   
   char leaf_name[NAME_MAX + 1];
   if (!dir_get_leaf_name (name, leaf_name))
@@ -160,30 +164,10 @@ static bool
 _filesys_create (const char *full_path, off_t initial_size, 
 		 bool is_dir)
 {
-  block_sector_t cwd = thread_current ()->cwd_sector;
-  bool found = true;
-  if (cwd != (block_sector_t) ROOT_DIR_SECTOR)
-    {
-      struct inode *curr = NULL;
-      curr = inode_open (cwd);      
-      struct dir *p;
-      p = dir_open (inode_open (curr->data.parent_dir_sector));      
-      struct dir_entry e;
-      size_t ofs;      
-      ASSERT (p != NULL);      
-      found = false;      
-      for (ofs = 0;
-	   inode_read_at (p->inode, &e, sizeof e, ofs) == sizeof e;
-	   ofs += sizeof e)
-	{
-	  if (e.inode_sector == cwd && e.in_use)
-	    {
-	      found = true;
-	      break;
-	    }
-	}
-    }
-  if (!found)
+  /* Nothing may be created in a working directory that has been
+     removed. */
+  struct dir *cwd = thread_current ()->cwd;
+  if (cwd != NULL && inode_is_removed (dir_get_inode (cwd)))
     return false;
 
   char leaf_name[NAME_MAX + 1];
@@ -203,7 +187,7 @@ _filesys_create (const char *full_path, off_t initial_size,
     }
   bool success = is_dir? dir_create (inode_sector, BLOCK_SECTOR_SIZE / 
 				     sizeof (struct dir_entry)) : 
-                         inode_create (inode_sector, initial_size);
+                         inode_create (inode_sector, initial_size, false);
   if (!success)
     {
       free_map_release (inode_sector, 1);
@@ -221,14 +205,48 @@ _filesys_create (const char *full_path, off_t initial_size,
   return true;
 }
 
+/* Creates an empty file named NAME, then grows it to
+   INITIAL_SIZE.  Growing a file may take many file system
+   operations, too many metadata changes for one, so a crash
+   part of the way may leave the file shorter. */
 bool filesys_create (const char *full_path, off_t initial_size)
 {
-  return _filesys_create (full_path, initial_size, false);
+  bool success;
+
+  journal_begin ();
+  success = _filesys_create (full_path, 0, false);
+  journal_end ();
+  if (success && initial_size > 0 && !_filesys_grow (full_path, initial_size))
+    {
+      filesys_remove (full_path);
+      success = false;
+    }
+  return success;
+}
+
+/* Extends the empty file named NAME with zeros to SIZE bytes.
+   Returns true if successful, false if the disk fills up. */
+static bool
+_filesys_grow (const char *name, off_t size)
+{
+  struct file *file = filesys_open (name);
+  bool success;
+
+  if (file == NULL)
+    return false;
+  success = file_write_at (file, "", 1, size - 1) == 1;
+  file_close (file);
+  return success;
 }
 
 bool filesys_mkdir (const char *full_path)
 {
-  return _filesys_create (full_path, 0, true);
+  bool success;
+
+  journal_begin ();
+  success = _filesys_create (full_path, 0, true);
+  journal_end ();
+  return success;
 }
 
 bool filesys_chdir (const char *full_path)
@@ -241,13 +259,20 @@ bool filesys_chdir (const char *full_path)
   if (parent_dir == NULL)
     return false;
   struct inode *tmp;
-  if (!dir_lookup (parent_dir, leaf_name, &tmp))
+  bool found = dir_lookup (parent_dir, leaf_name, &tmp);
+  dir_close (parent_dir);
+  if (!found)
     return false;
   if (!inode_is_dir (tmp))
-    return false;
+    {
+      inode_close (tmp);
+      return false;
+    }
   struct dir *actual_dir = dir_open (tmp);
-  thread_current()->cwd_sector = inode_get_inumber(dir_get_inode (actual_dir));
-  dir_close (actual_dir);
+  if (actual_dir == NULL)
+    return false;
+  dir_close (thread_current ()->cwd);
+  thread_current ()->cwd = actual_dir;
   return true;
 }
 
@@ -271,6 +296,28 @@ filesys_inumber (int fd)
   return inode_get_inumber (inode);
 }
 
+/* Writes the file open as FD, and the metadata it depends on,
+   such as the free map, to disk.  Returns false if FD is not
+   open. */
+bool
+filesys_fsync (int fd)
+{
+  struct file *file = file_find (fd);
+  if (file == NULL)
+    return false;
+  inode_sync (file_get_inode (file));
+  return true;
+}
+
+/* Writes every open inode, the free map and every dirty sector
+   in the buffer cache to disk. */
+void
+filesys_sync (void)
+{
+  inode_save_all ();
+  cache_sync ();
+}
+
 
 /* Formats the file system. */
 static void
@@ -284,19 +331,52 @@ do_format (void)
   printf ("done.\n");
 }
 
-bool filesys_readdir (int fd, char *name)
+/* Opens a directory for the directory file open as FD, positioned
+   at the file's current position, and stores the file in *FILEP.
+   Returns a null pointer if FD is not an open directory. */
+static struct dir *
+_filesys_open_dir_fd (int fd, struct file **filep)
 {
   struct file *file = file_find (fd);
   if (file == NULL)
-    return false;
+    return NULL;
   struct inode *inode = file_get_inode (file);
   if (!inode_is_dir (inode))
-    return false;
-  struct dir *dir = dir_open (inode);
+    return NULL;
+  struct dir *dir = dir_open (inode_reopen (inode));
+  if (dir == NULL)
+    return NULL;
   dir_set_pos (dir, file_tell (file));
+  *filep = file;
+  return dir;
+}
+
+bool filesys_readdir (int fd, char *name)
+{
+  struct file *file;
+  struct dir *dir = _filesys_open_dir_fd (fd, &file);
+  if (dir == NULL)
+    return false;
   bool success = dir_readdir (dir, name);
   file_seek (file, dir_get_pos (dir));
   dir_close (dir);
   return success;
 }
 
+/* Reads as many entries of the directory open as FD as fit in the
+   SIZE bytes at BUFFER.  Returns the number of bytes written, 0 at
+   end of directory, or -1 if FD is not a directory or SIZE cannot
+   hold the next entry. */
+int
+filesys_readdir_batch (int fd, void *buffer, size_t size)
+{
+  struct file *file;
+  struct dir *dir = _filesys_open_dir_fd (fd, &file);
+  if (dir == NULL)
+    return -1;
+  int bytes = dir_readdir_batch (dir, buffer, size);
+  file_seek (file, dir_get_pos (dir));
+  dir_close (dir);
+  return bytes;
+}
+
@@ -2,17 +2,22 @@
 #define FILESYS_FILESYS_H
 
 #include <stdbool.h>
+#include <stddef.h>
 #include "filesys/off_t.h"
 
 /* Sectors of system file inodes. */
 #define FREE_MAP_SECTOR 0       /* Free map file inode sector. */
 #define ROOT_DIR_SECTOR 1       /* Root directory file inode sector. */
+#define JOURNAL_SECTOR 2        /* First sector of metadata journal. */
 
-#define FULLPATH_MAX_LEN 280
+#define FULLPATH_MAX_LEN 1024
 
 /* Block device that contains the file system. */
 struct block *fs_device;
 
+/* -noflush: Skip writing back the file system at shutdown. */
+extern bool filesys_no_flush;
+
 void filesys_init (bool format);
 void filesys_done (void);
 bool filesys_create (const char *name, off_t initial_size);
@@ -21,6 +26,9 @@ bool filesys_remove (const char *name);
 bool filesys_mkdir (const char *name);
 bool filesys_chdir (const char *name);
 bool filesys_readdir (int fd, char *name);
+int filesys_readdir_batch (int fd, void *buffer, size_t size);
 bool filesys_isdir (int fd);
 int filesys_inumber (int fd);
+bool filesys_fsync (int fd);
+void filesys_sync (void);
 #endif /* filesys/filesys.h */
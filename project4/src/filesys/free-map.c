@@ -3,6 +3,7 @@
 #include <debug.h>
 #include "filesys/file.h"
 #include "filesys/filesys.h"
+#include "filesys/journal.h"
 #include "threads/synch.h"
 
 static struct file *free_map_file;   /* Free map file. */
@@ -19,6 +20,7 @@ free_map_init (void)
     PANIC ("bitmap creation failed--file system device is too large");
   bitmap_mark (free_map, FREE_MAP_SECTOR);
   bitmap_mark (free_map, ROOT_DIR_SECTOR);
+  bitmap_set_multiple (free_map, JOURNAL_SECTOR, JOURNAL_SIZE, true);
 }
 
 /* Allocates CNT consecutive sectors from the free map and stores
@@ -102,7 +104,7 @@ void
 free_map_create (void) 
 {
   /* Create inode. */
-  if (!inode_create (FREE_MAP_SECTOR, bitmap_file_size (free_map)))
+  if (!inode_create (FREE_MAP_SECTOR, bitmap_file_size (free_map), false))
     PANIC ("free map creation failed");
 
   /* Write bitmap to file. */
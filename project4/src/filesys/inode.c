@@ -3,6 +3,7 @@
 #include <string.h>
 #include "filesys/filesys.h"
 #include "filesys/free-map.h"
+#include "filesys/journal.h"
 #include "threads/malloc.h"
 #include "filesys/cache.h"
 #include <stdio.h>
@@ -16,6 +17,16 @@
 #define MI_NUM_INDIRECT (MI_SIZE - MI_NUM_DIRECT - MI_NUM_DOUBLY_INDIRECT)
 #define INVALID_SECTOR_INDEX ((block_sector_t) (-1))
 
+/* Most sectors inode_create() zeroes with a single write. */
+#define ZERO_RUN_MAX 8
+
+/* Most sectors extend_and_write() allocates in one file system
+   operation.  Even for a directory, whose sectors are all
+   metadata, that keeps the metadata the operation dirties,
+   including index blocks, the free map and the inode, within
+   JOURNAL_OP_SECTORS. */
+#define EXTEND_MAX_SECTORS 8
+
 /* Returns the number of sectors to allocate for an inode SIZE
    bytes long. */
 static inline size_t
@@ -92,7 +103,7 @@ _create_new_sector_ptr_block (struct inode_disk *disk_inode)
   for (idx = 0; idx < SECTORS_PER_BLOCK; ++idx)
     buffer[idx] = INVALID_SECTOR_INDEX;
   cache_write (fs_device, sector_tmp, buffer, 
-	       0, BLOCK_SECTOR_SIZE, disk_inode);
+	       0, BLOCK_SECTOR_SIZE, disk_inode, true);
   return sector_tmp;
 }
 
@@ -127,7 +138,7 @@ put_sector (struct inode_disk *disk_inode,
 		  buffer, 0, BLOCK_SECTOR_SIZE, disk_inode);
       buffer[block_index % SECTORS_PER_BLOCK] = sector;
       cache_write (fs_device, disk_inode->multi_index[level_1_index],
-		   buffer, 0, BLOCK_SECTOR_SIZE, disk_inode);
+		   buffer, 0, BLOCK_SECTOR_SIZE, disk_inode, true);
     }
   else
     {
@@ -150,10 +161,19 @@ put_sector (struct inode_disk *disk_inode,
       block_sector_t tmp = buffer[block_index / SECTORS_PER_BLOCK];
       cache_read (fs_device, tmp, buffer, 0, BLOCK_SECTOR_SIZE, disk_inode);
       buffer[block_index % SECTORS_PER_BLOCK] = sector;
-      cache_write (fs_device, tmp, buffer, 0, BLOCK_SECTOR_SIZE, disk_inode);
+      cache_write (fs_device, tmp, buffer, 0, BLOCK_SECTOR_SIZE, disk_inode,
+		   true);
     }
 }
 
+/* Returns true if INODE's contents are file system metadata:
+   a directory or the free map. */
+static bool
+is_metadata (const struct inode *inode)
+{
+  return inode->data.is_dir || inode->sector == FREE_MAP_SECTOR;
+}
+
 /* Returns the block device sector that contains byte offset POS
    within INODE.
    Returns -1 if INODE does not contain data for a byte at offset
@@ -181,11 +201,13 @@ inode_init (void)
 
 /* Initializes an inode with LENGTH bytes of data and
    writes the new inode to sector SECTOR on the file system
-   device.
+   device.  IS_DIR marks it as a directory, whose zeroed sectors
+   are metadata and so go through the buffer cache and the
+   journal.
    Returns true if successful.
    Returns false if memory or disk allocation fails. */
 bool
-inode_create (block_sector_t sector, off_t length)
+inode_create (block_sector_t sector, off_t length, bool is_dir)
 {
   struct inode_disk *disk_inode = NULL;
   bool success = false;
@@ -202,7 +224,7 @@ inode_create (block_sector_t sector, off_t length)
       size_t sectors = bytes_to_sectors (length);
       disk_inode->length = length;
       disk_inode->magic = INODE_MAGIC;
-      disk_inode->is_dir = false;
+      disk_inode->is_dir = is_dir;
       disk_inode->parent_dir_sector = ROOT_DIR_SECTOR;
 
       /* intialize the multi-level index table as all INVALID_SECTOR_INDEX 
@@ -213,14 +235,36 @@ inode_create (block_sector_t sector, off_t length)
 
       if (free_map_allocate_multiple (sectors, 0, disk_inode))
         {
-          block_write (fs_device, sector, disk_inode);
+          cache_write (fs_device, sector, disk_inode, 0, BLOCK_SECTOR_SIZE,
+                       NULL, true);
           if (sectors > 0) 
             {
-              static char zeros[BLOCK_SECTOR_SIZE];
-              size_t i;
+              static char zeros[ZERO_RUN_MAX * BLOCK_SECTOR_SIZE];
+              size_t i, run;
               
-              for (i = 0; i < sectors; i++)
-                block_write (fs_device, get_sector (disk_inode, i), zeros);
+              if (is_dir)
+                {
+                  /* Directory sectors are committed with the
+                     inode, through the journal. */
+                  for (i = 0; i < sectors; i++)
+                    cache_write (fs_device, get_sector (disk_inode, i),
+                                 zeros, 0, BLOCK_SECTOR_SIZE, NULL, true);
+                }
+              else
+                {
+                  /* Zero runs of consecutive data sectors with one
+                     multi-sector write each, before the inode that
+                     points to them can be committed. */
+                  for (i = 0; i < sectors; i += run)
+                    {
+                      block_sector_t start = get_sector (disk_inode, i);
+                      for (run = 1;
+                           run < ZERO_RUN_MAX && i + run < sectors; run++)
+                        if (get_sector (disk_inode, i + run) != start + run)
+                          break;
+                      block_write_multiple (fs_device, start, run, zeros);
+                    }
+                }
             }
           success = true; 
         } 
@@ -264,7 +308,8 @@ inode_open (block_sector_t sector)
   
   lock_init (&inode->extension_lock);
 
-  block_read (fs_device, inode->sector, &inode->data);
+  cache_read (fs_device, inode->sector, &inode->data, 0, BLOCK_SECTOR_SIZE,
+              &inode->data);
   return inode;
 }
 
@@ -297,9 +342,12 @@ inode_close (struct inode *inode)
   /* Release resources if this was the last opener. */
   if (--inode->open_cnt == 0)
     {
-      /* Flush cache */
+      journal_begin ();
+
+
+      /* Flush cache, inode included */
+      inode_save (inode);
       cache_flush (&inode->data);
-      block_write (fs_device, inode->sector, &inode->data);
  
       /* Remove from inode list and release lock. */
       list_remove (&inode->elem);
@@ -313,6 +361,7 @@ inode_close (struct inode *inode)
         }
 
       free (inode); 
+      journal_end ();
     }
 }
 
@@ -365,22 +414,30 @@ inode_read_at (struct inode *inode, void *buffer_, off_t size, off_t offset)
   return bytes_read;
 }
 
+/* Grows INODE toward OFFSET and writes SIZE bytes from BUFFER
+   there, as one file system operation that allocates at most
+   EXTEND_MAX_SECTORS sectors.  Returns the number of bytes
+   written, which is 0 if the operation only got part of the way
+   to OFFSET; INODE's length tells that from failure. */
 static off_t
 extend_and_write (struct inode *inode, const void *buffer_, off_t size,
                 off_t offset) 
 {
+  journal_begin ();
   lock_acquire (&inode->extension_lock);
   const uint8_t *buffer = buffer_;
 
   if (inode->deny_write_cnt)
     {
       lock_release (&inode->extension_lock);
+      journal_end ();
       return 0;
     }
   off_t bytes_written = 0;
+  int allocated = 0;
   uint8_t zeros[BLOCK_SECTOR_SIZE];
   memset (zeros, 0, BLOCK_SECTOR_SIZE);
-  while (size > 0) 
+  while (size > 0 && allocated < EXTEND_MAX_SECTORS) 
     {
       off_t flength = inode_length (inode);
       block_sector_t sector_idx = get_sector (&inode->data, 
@@ -390,16 +447,22 @@ extend_and_write (struct inode *inode, const void *buffer_, off_t size,
         {
           if (free_map_allocate_multiple (1, flength / BLOCK_SECTOR_SIZE, 
 					  &inode->data))
-	    sector_idx = get_sector (&inode->data, flength/BLOCK_SECTOR_SIZE);
+	    {
+	      sector_idx = get_sector (&inode->data,
+				       flength / BLOCK_SECTOR_SIZE);
+	      allocated++;
+	    }
 	  else
             {
               lock_release (&inode->extension_lock);
+              journal_end ();
               return bytes_written;
             }
         }
       off_t block_left = BLOCK_SECTOR_SIZE - block_start;
       cache_write (fs_device, sector_idx, zeros + block_start, 
-                   block_start, block_left, &inode->data);
+                   block_start, block_left, &inode->data,
+                   is_metadata (inode));
 
       if (sector_idx == get_sector (&inode->data, 
 				    offset / BLOCK_SECTOR_SIZE))
@@ -409,7 +472,8 @@ extend_and_write (struct inode *inode, const void *buffer_, off_t size,
           int chunk_size = size < sector_left ? size : sector_left;
 
           cache_write (fs_device, sector_idx, buffer + bytes_written,
-                       sector_ofs, chunk_size, &inode->data);
+                       sector_ofs, chunk_size, &inode->data,
+                       is_metadata (inode));
 
           size -= chunk_size;
           offset += chunk_size;
@@ -423,14 +487,15 @@ extend_and_write (struct inode *inode, const void *buffer_, off_t size,
     }
 
   lock_release (&inode->extension_lock);
+  journal_end ();
   return bytes_written;
 }
 
 /* Writes SIZE bytes from BUFFER into INODE, starting at OFFSET.
    Returns the number of bytes actually written, which may be
-   less than SIZE if end of file is reached or an error occurs.
-   (Normally a write at end of file would extend the inode, but
-   growth is not yet implemented.) */
+   less than SIZE if the disk fills up or an error occurs.
+   Writing past end of file extends the inode, a few sectors per
+   file system operation. */
 off_t
 inode_write_at (struct inode *inode, const void *buffer_, off_t size,
                 off_t offset) 
@@ -445,9 +510,15 @@ inode_write_at (struct inode *inode, const void *buffer_, off_t size,
     {
       if (offset >= inode_length (inode))
         {
-          bytes_written += extend_and_write (inode, buffer + bytes_written, 
-					     size, offset);
-          return bytes_written;
+          off_t length = inode_length (inode);
+          off_t chunk_size = extend_and_write (inode, buffer + bytes_written,
+                                               size, offset);
+          size -= chunk_size;
+          offset += chunk_size;
+          bytes_written += chunk_size;
+          if (inode_length (inode) == length)
+            break;
+          continue;
         }
           
       /* Sector to write, starting byte offset within sector. */
@@ -465,7 +536,7 @@ inode_write_at (struct inode *inode, const void *buffer_, off_t size,
         break;
 
       cache_write (fs_device, sector_idx, buffer + bytes_written,
-		   sector_ofs, chunk_size, &inode->data);
+		   sector_ofs, chunk_size, &inode->data, is_metadata (inode));
       
       /* Advance. */
       size -= chunk_size;
@@ -512,8 +583,60 @@ inode_is_dir (const struct inode *inode)
 void
 inode_set_is_dir (struct inode *inode)
 {
+   if (inode->data.is_dir)
+     return;
    inode->data.is_dir = true;
-   block_write (fs_device, inode->sector, &inode->data);
+   inode_save (inode);
+}
+
+/* Writes INODE's on-disk inode to the buffer cache, from which
+   it reaches disk through the journal.  Like any other change to
+   metadata, this is part of a file system operation. */
+void
+inode_save (struct inode *inode)
+{
+  journal_begin ();
+  cache_write (fs_device, inode->sector, &inode->data, 0, BLOCK_SECTOR_SIZE,
+               &inode->data, true);
+  journal_end ();
+}
+
+/* Writes the on-disk inode of every open inode that has not been
+   removed to the buffer cache.  Inodes that stay open, such as
+   the root directory pinned as a working directory, are otherwise
+   only saved when they are closed. */
+void
+inode_save_all (void)
+{
+  struct list_elem *e;
+
+  for (e = list_begin (&open_inodes); e != list_end (&open_inodes);
+       e = list_next (e))
+    {
+      struct inode *inode = list_entry (e, struct inode, elem);
+      if (!inode->removed)
+        inode_save (inode);
+    }
+}
+
+/* Writes INODE's on-disk inode and its dirty cached sectors to
+   disk, keeping them in the buffer cache.  Other files' data
+   stays in the cache unless metadata committed along with
+   INODE's points to it: the journal keeps global ordered-mode
+   semantics, so committing INODE's metadata commits all other
+   metadata not yet committed, including the free map. */
+void
+inode_sync (struct inode *inode)
+{
+  inode_save (inode);
+  cache_sync_inode (&inode->data);
+}
+
+/* Returns true if INODE has been removed from its directory. */
+bool
+inode_is_removed (const struct inode *inode)
+{
+   return inode->removed;
 }
 
 void
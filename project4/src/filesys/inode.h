@@ -39,7 +39,7 @@ struct inode
 
 
 void inode_init (void);
-bool inode_create (block_sector_t, off_t);
+bool inode_create (block_sector_t, off_t, bool is_dir);
 struct inode *inode_open (block_sector_t);
 struct inode *inode_reopen (struct inode *);
 block_sector_t inode_get_inumber (const struct inode *);
@@ -58,6 +58,10 @@ void put_sector (struct inode_disk *disk_inode,
 
 bool inode_is_dir (const struct inode *);
 void inode_set_is_dir (struct inode *);
+void inode_save (struct inode *);
+void inode_save_all (void);
+void inode_sync (struct inode *);
+bool inode_is_removed (const struct inode *);
 block_sector_t inode_get_parent_dir_sector (struct inode *inode);
 void inode_set_parent_dir_sector (struct inode *inode, block_sector_t parent_dir_sector);
 
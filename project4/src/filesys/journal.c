@@ -0,0 +1,305 @@
+#include "filesys/journal.h"
+#include <debug.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <string.h>
+#include "filesys/cache.h"
+#include "filesys/filesys.h"
+#include "threads/malloc.h"
+#include "threads/synch.h"
+#include "threads/thread.h"
+
+/* A write-ahead journal for file system metadata.
+
+   Inodes, index blocks, directories and the free map are not
+   written in place straight from the buffer cache.  Each file
+   system operation that changes metadata, such as creating,
+   removing or extending a file, runs between journal_begin() and
+   journal_end(), and the cache holds on to dirty metadata instead
+   of evicting it.  Each operation may dirty at most
+   JOURNAL_OP_SECTORS sectors, which journal_begin() sets aside,
+   so that the dirty metadata never outgrows a transaction or the
+   cache.  Metadata is only written back by cache_sync(),
+   which first waits, through journal_quiesce(), until no
+   operation is in progress, so that every transaction holds whole
+   operations.  It writes file data first, so that committed
+   metadata never points to data that is not on disk, then hands
+   the new contents of all the dirty metadata sectors to
+   journal_commit() as one transaction.
+
+   Many file system operations thus share one commit, and the
+   commit costs a single sequential write to the journal: a header
+   listing the home sector of each image, followed by the images.
+   Only after that write completes are the images written to their
+   home locations, after which the header is cleared.
+
+   If the machine stops after a commit but before the header is
+   cleared, journal_init() finds the committed transaction at the
+   next boot and writes its images home again.  A checksum over
+   the transaction tells a complete commit from a torn one, which
+   is ignored, leaving the previous metadata in place.
+
+   File data is not journaled. */
+
+/* Identifies a journal header. */
+#define JOURNAL_MAGIC 0x4c4e524a
+
+/* Journal header, at JOURNAL_SECTOR.
+   Must be exactly BLOCK_SECTOR_SIZE bytes long. */
+struct journal_header
+  {
+    uint32_t magic;                     /* JOURNAL_MAGIC. */
+    uint32_t seq;                       /* Last transaction committed. */
+    uint32_t cnt;                       /* Images in the committed
+                                           transaction, or 0 if it has
+                                           been written home. */
+    uint32_t checksum;                  /* Over SEQ, CNT, the home
+                                           sectors and the images. */
+    block_sector_t sectors[JOURNAL_MAX_SECTORS]; /* Home sectors. */
+    uint8_t unused[BLOCK_SECTOR_SIZE - 16
+                   - JOURNAL_MAX_SECTORS * sizeof (block_sector_t)];
+  };
+
+/* Serializes transactions. */
+static struct lock journal_lock;
+
+/* Operations in progress, and whether a thread waits in
+   journal_quiesce() for them to end.  Protected by op_lock. */
+static struct lock op_lock;
+static struct condition op_cond;
+static int op_cnt;
+static bool quiescing;
+
+/* Staging area for the header and images of a transaction, laid
+   out as they are on disk so that one write covers them all. */
+static struct journal_header *header;
+static uint8_t *images_buf;
+
+static bool op_fits (void);
+static void write_header (void);
+static uint32_t checksum (void);
+static void write_home (void);
+
+/* Initializes the journal.  If FORMAT is true, creates an empty
+   journal.  Otherwise, writes home any transaction that was
+   committed but not yet written home when the file system was
+   last used. */
+void
+journal_init (bool format)
+{
+  ASSERT (sizeof (struct journal_header) == BLOCK_SECTOR_SIZE);
+
+  lock_init (&journal_lock);
+  lock_init (&op_lock);
+  cond_init (&op_cond);
+  header = malloc (JOURNAL_SIZE * BLOCK_SECTOR_SIZE);
+  if (header == NULL)
+    PANIC ("can't allocate journal buffer");
+  images_buf = (uint8_t *) header + BLOCK_SECTOR_SIZE;
+
+  if (format)
+    {
+      memset (header, 0, BLOCK_SECTOR_SIZE);
+      header->magic = JOURNAL_MAGIC;
+      write_header ();
+      return;
+    }
+
+  block_read (fs_device, JOURNAL_SECTOR, header);
+  if (header->magic != JOURNAL_MAGIC)
+    PANIC ("file system has no journal--reformat it with -f");
+  if (header->cnt > 0 && header->cnt <= JOURNAL_MAX_SECTORS)
+    {
+      block_read_multiple (fs_device, JOURNAL_SECTOR + 1, header->cnt,
+                           images_buf);
+      if (header->checksum == checksum ())
+        {
+          printf ("filesys: replaying %"PRIu32" sectors from journal\n",
+                  header->cnt);
+          write_home ();
+        }
+      header->cnt = 0;
+      write_header ();
+    }
+}
+
+/* Starts a file system operation whose metadata changes must
+   reach disk together.  Operations may nest; only the outermost
+   counts.  If the dirty metadata in the cache and the operations
+   in progress leave no room for another JOURNAL_OP_SECTORS
+   sectors in the next transaction, waits for those operations to
+   end, then commits. */
+void
+journal_begin (void)
+{
+  struct thread *t = thread_current ();
+
+  if (t->journal_depth > 0)
+    {
+      t->journal_depth++;
+      return;
+    }
+
+  lock_acquire (&op_lock);
+  while (quiescing || !op_fits ())
+    if (!quiescing && op_cnt == 0)
+      {
+        lock_release (&op_lock);
+        cache_sync ();
+        lock_acquire (&op_lock);
+      }
+    else
+      cond_wait (&op_cond, &op_lock);
+  op_cnt++;
+  lock_release (&op_lock);
+  t->journal_depth = 1;
+}
+
+/* Ends the operation started by the matching journal_begin(). */
+void
+journal_end (void)
+{
+  struct thread *t = thread_current ();
+
+  ASSERT (t->journal_depth > 0);
+  if (--t->journal_depth > 0)
+    return;
+
+  lock_acquire (&op_lock);
+  op_cnt--;
+  cond_broadcast (&op_cond, &op_lock);
+  lock_release (&op_lock);
+}
+
+/* Returns true if one more operation fits in the next
+   transaction, along with the dirty metadata in the cache and
+   the operations in progress.  The caller must hold op_lock. */
+static bool
+op_fits (void)
+{
+  return (cache_dirty_meta_cnt () + (op_cnt + 1) * JOURNAL_OP_SECTORS
+          <= JOURNAL_MAX_SECTORS);
+}
+
+/* Waits until no operation is in progress and keeps new ones
+   from starting until journal_resume(), so that the metadata in
+   the cache is consistent and may be committed.  Must not be
+   called inside an operation. */
+void
+journal_quiesce (void)
+{
+  ASSERT (thread_current ()->journal_depth == 0);
+
+  lock_acquire (&op_lock);
+  while (quiescing)
+    cond_wait (&op_cond, &op_lock);
+  quiescing = true;
+  while (op_cnt > 0)
+    cond_wait (&op_cond, &op_lock);
+  lock_release (&op_lock);
+}
+
+/* Lets operations start again after journal_quiesce(). */
+void
+journal_resume (void)
+{
+  lock_acquire (&op_lock);
+  ASSERT (quiescing);
+  quiescing = false;
+  cond_broadcast (&op_cond, &op_lock);
+  lock_release (&op_lock);
+}
+
+/* Commits CNT metadata sectors, whose home sectors are SECTORS and
+   whose new contents are IMAGES, as one transaction, then writes
+   them to their home locations.  Returns once all of them are on
+   disk.  If SECTORS is in ascending order, adjacent home sectors
+   are written with one request. */
+void
+journal_commit (const block_sector_t sectors[], const void *const images[],
+                size_t cnt)
+{
+  size_t i;
+
+  ASSERT (cnt > 0 && cnt <= JOURNAL_MAX_SECTORS);
+
+  lock_acquire (&journal_lock);
+
+  /* Commit: the header and images in one sequential write. */
+  header->seq++;
+  header->cnt = cnt;
+  for (i = 0; i < cnt; i++)
+    {
+      header->sectors[i] = sectors[i];
+      memcpy (images_buf + i * BLOCK_SECTOR_SIZE, images[i],
+              BLOCK_SECTOR_SIZE);
+    }
+  header->checksum = checksum ();
+  block_write_multiple (fs_device, JOURNAL_SECTOR, 1 + cnt, header);
+
+  /* Checkpoint: write the images home, then retire the
+     transaction so that it is not replayed over sectors that are
+     later freed and reused for file data. */
+  write_home ();
+  header->cnt = 0;
+  write_header ();
+
+  lock_release (&journal_lock);
+}
+
+/* Writes the journal header to disk. */
+static void
+write_header (void)
+{
+  block_write (fs_device, JOURNAL_SECTOR, header);
+}
+
+/* Returns HASH updated with the SIZE bytes at BUF, FNV-1a style. */
+static uint32_t
+hash_bytes (uint32_t hash, const void *buf, size_t size)
+{
+  const uint8_t *p = buf;
+  size_t i;
+
+  for (i = 0; i < size; i++)
+    hash = (hash ^ p[i]) * 16777619u;
+  return hash;
+}
+
+/* Returns a checksum of the transaction staged in HEADER and
+   IMAGES_BUF. */
+static uint32_t
+checksum (void)
+{
+  uint32_t hash = 2166136261u;
+
+  hash = hash_bytes (hash, &header->seq, sizeof header->seq);
+  hash = hash_bytes (hash, &header->cnt, sizeof header->cnt);
+  hash = hash_bytes (hash, header->sectors,
+                     header->cnt * sizeof *header->sectors);
+  return hash_bytes (hash, images_buf, header->cnt * BLOCK_SECTOR_SIZE);
+}
+
+/* Writes each image of the transaction staged in HEADER and
+   IMAGES_BUF to its home sector, submitting one request per run
+   of adjacent sectors and waiting for all of them. */
+static void
+write_home (void)
+{
+  /* Too big for a kernel stack; protected by journal_lock, or
+     used before other threads can reach the journal. */
+  static struct block_request reqs[JOURNAL_MAX_SECTORS];
+  size_t i, j, req_cnt = 0;
+
+  for (i = 0; i < header->cnt; i = j)
+    {
+      for (j = i + 1; j < header->cnt; j++)
+        if (header->sectors[j] != header->sectors[i] + (j - i))
+          break;
+      block_request_init (&reqs[req_cnt], true, header->sectors[i], j - i,
+                          images_buf + i * BLOCK_SECTOR_SIZE, NULL, NULL);
+      block_submit (fs_device, &reqs[req_cnt++]);
+    }
+  for (i = 0; i < req_cnt; i++)
+    block_wait (&reqs[i]);
+}
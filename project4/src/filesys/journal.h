@@ -0,0 +1,27 @@
+#ifndef FILESYS_JOURNAL_H
+#define FILESYS_JOURNAL_H
+
+#include <stdbool.h>
+#include <stddef.h>
+#include "devices/block.h"
+
+/* Most metadata sectors a single transaction can hold. */
+#define JOURNAL_MAX_SECTORS 48
+
+/* Most metadata sectors a single file system operation may
+   dirty. */
+#define JOURNAL_OP_SECTORS 16
+
+/* Sectors reserved for the journal, starting at JOURNAL_SECTOR:
+   a header followed by room for each image. */
+#define JOURNAL_SIZE (1 + JOURNAL_MAX_SECTORS)
+
+void journal_init (bool format);
+void journal_begin (void);
+void journal_end (void);
+void journal_quiesce (void);
+void journal_resume (void);
+void journal_commit (const block_sector_t sectors[],
+                     const void *const images[], size_t cnt);
+
+#endif /* filesys/journal.h */
@@ -182,3 +182,27 @@ inumber (int fd)
 {
   return syscall1 (SYS_INUMBER, fd);
 }
+
+int
+readdir_batch (int fd, void *buffer, unsigned size)
+{
+  return syscall3 (SYS_READDIR_BATCH, fd, buffer, size);
+}
+
+bool
+fsync (int fd)
+{
+  return syscall1 (SYS_FSYNC, fd);
+}
+
+void
+sync (void)
+{
+  syscall0 (SYS_SYNC);
+}
+
+void
+yield (void)
+{
+  syscall0 (SYS_YIELD);
+}
@@ -13,7 +13,18 @@ typedef int mapid_t;
 #define MAP_FAILED ((mapid_t) -1)
 
 /* Maximum characters in a filename written by readdir(). */
-#define READDIR_MAX_LEN 14
+#define READDIR_MAX_LEN 255
+
+/* A directory entry written by readdir_batch().  Entries are
+   packed one after another; REC_LEN is the offset from the start
+   of one entry to the next. */
+struct readdir_entry
+  {
+    int inumber;                /* Inode number. */
+    unsigned short rec_len;     /* Bytes to the next entry. */
+    bool is_dir;                /* Is it a directory? */
+    char name[];                /* Null terminated file name. */
+  };
 
 /* Typical return values from main() and arguments to exit(). */
 #define EXIT_SUCCESS 0          /* Successful execution. */
@@ -44,5 +55,9 @@ bool mkdir (const char *dir);
 bool readdir (int fd, char name[READDIR_MAX_LEN + 1]);
 bool isdir (int fd);
 int inumber (int fd);
+int readdir_batch (int fd, void *buffer, unsigned size);
+bool fsync (int fd);
+void sync (void);
+void yield (void);
 
 #endif /* lib/user/syscall.h */
@@ -0,0 +1,8 @@
+# -*- perl -*-
+use strict;
+use warnings;
+use tests::tests;
+my ($dir) = {'sub' => {}};
+$dir->{"file$_"} = [''] foreach 0...19;
+check_archive ({'a' => $dir});
+pass;
@@ -0,0 +1,78 @@
+/* Lists a directory with readdir_batch() through a buffer too
+   small to hold every entry at once, and verifies that each entry
+   comes back exactly once with the right type and inumber. */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <syscall.h>
+#include "tests/lib.h"
+#include "tests/main.h"
+
+#define FILE_CNT 20
+
+void
+test_main (void) 
+{
+  char buffer[64];
+  bool seen[FILE_CNT + 1];
+  int dir_fd, size, call_cnt;
+  int i;
+
+  CHECK (mkdir ("a"), "mkdir \"a\"");
+  CHECK (mkdir ("a/sub"), "mkdir \"a/sub\"");
+  msg ("creating %d files in \"a\"", FILE_CNT);
+  for (i = 0; i < FILE_CNT; i++)
+    {
+      char name[16];
+      snprintf (name, sizeof name, "a/file%d", i);
+      if (!create (name, 0))
+        fail ("create \"%s\" failed", name);
+    }
+
+  CHECK ((dir_fd = open ("a")) > 1, "open \"a\"");
+  memset (seen, 0, sizeof seen);
+  call_cnt = 0;
+  while ((size = readdir_batch (dir_fd, buffer, sizeof buffer)) > 0)
+    {
+      const struct readdir_entry *e;
+      int ofs;
+
+      call_cnt++;
+      for (ofs = 0; ofs < size; ofs += e->rec_len)
+        {
+          char name[16];
+          int idx, fd;
+
+          e = (const struct readdir_entry *) (buffer + ofs);
+          if (!strcmp (e->name, "sub"))
+            idx = FILE_CNT;
+          else if (!memcmp (e->name, "file", 4))
+            idx = atoi (e->name + 4);
+          else
+            fail ("unexpected entry \"%s\"", e->name);
+          if (idx < 0 || idx > FILE_CNT || seen[idx])
+            fail ("entry \"%s\" returned twice", e->name);
+          seen[idx] = true;
+
+          if (e->is_dir != (idx == FILE_CNT))
+            fail ("entry \"%s\" has the wrong type", e->name);
+          snprintf (name, sizeof name, "a/%s", e->name);
+          if ((fd = open (name)) < 2)
+            fail ("open \"%s\" failed", name);
+          if (inumber (fd) != e->inumber)
+            fail ("entry \"%s\" has the wrong inumber", e->name);
+          close (fd);
+        }
+    }
+  CHECK (size == 0, "readdir_batch reached end of \"a\"");
+  for (i = 0; i <= FILE_CNT; i++)
+    if (!seen[i])
+      fail ("entry %d missing", i);
+  if (call_cnt < 2)
+    fail ("whole directory fit in one %zu-byte buffer", sizeof buffer);
+  msg ("every entry returned exactly once");
+  CHECK (readdir_batch (dir_fd, buffer, sizeof buffer) == 0,
+         "readdir_batch stays at end of \"a\"");
+  close (dir_fd);
+}
@@ -0,0 +1,16 @@
+# -*- perl -*-
+use strict;
+use warnings;
+use tests::tests;
+check_expected (IGNORE_EXIT_CODES => 1, [<<'EOF']);
+(dir-readdir-batch) begin
+(dir-readdir-batch) mkdir "a"
+(dir-readdir-batch) mkdir "a/sub"
+(dir-readdir-batch) creating 20 files in "a"
+(dir-readdir-batch) open "a"
+(dir-readdir-batch) readdir_batch reached end of "a"
+(dir-readdir-batch) every entry returned exactly once
+(dir-readdir-batch) readdir_batch stays at end of "a"
+(dir-readdir-batch) end
+EOF
+pass;
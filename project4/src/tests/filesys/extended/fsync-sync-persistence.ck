@@ -0,0 +1,9 @@
+# -*- perl -*-
+use strict;
+use warnings;
+use tests::tests;
+use tests::random;
+my ($synced) = random_bytes (1234);
+my ($testme) = random_bytes (5678);
+check_archive ({"synced" => [$synced], "testme" => [$testme]});
+pass;
@@ -0,0 +1,46 @@
+/* Writes a file and forces it to disk with sync(), then writes
+   another and forces it to disk with fsync() alone, checking that
+   fsync() rejects a file descriptor that is not open and that
+   the data reads back intact.
+
+   The kernel runs with -noflush, so nothing else commits the
+   inodes, root directory and free map.  The persistence check
+   then finds "synced" only if sync() really wrote them to disk,
+   and "testme" only if fsync() did. */
+
+#include <random.h>
+#include <syscall.h>
+#include "tests/lib.h"
+#include "tests/main.h"
+
+static char buf1[1234];
+static char buf2[5678];
+
+void
+test_main (void) 
+{
+  int fd;
+
+  random_init (0);
+  random_bytes (buf1, sizeof buf1);
+  random_bytes (buf2, sizeof buf2);
+
+  CHECK (create ("synced", 0), "create \"synced\"");
+  CHECK ((fd = open ("synced")) > 1, "open \"synced\"");
+  CHECK (write (fd, buf1, sizeof buf1) == sizeof buf1, "write \"synced\"");
+  msg ("sync");
+  sync ();
+  msg ("close \"synced\"");
+  close (fd);
+
+  CHECK (create ("testme", 0), "create \"testme\"");
+  CHECK ((fd = open ("testme")) > 1, "open \"testme\"");
+  CHECK (write (fd, buf2, sizeof buf2) == sizeof buf2, "write \"testme\"");
+  CHECK (fsync (fd), "fsync \"testme\"");
+  CHECK (!fsync (fd + 100), "fsync unopened fd");
+  msg ("close \"testme\"");
+  close (fd);
+
+  check_file ("synced", buf1, sizeof buf1);
+  check_file ("testme", buf2, sizeof buf2);
+}
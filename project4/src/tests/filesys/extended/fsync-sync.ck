@@ -0,0 +1,26 @@
+# -*- perl -*-
+use strict;
+use warnings;
+use tests::tests;
+check_expected (IGNORE_EXIT_CODES => 1, [<<'EOF']);
+(fsync-sync) begin
+(fsync-sync) create "synced"
+(fsync-sync) open "synced"
+(fsync-sync) write "synced"
+(fsync-sync) sync
+(fsync-sync) close "synced"
+(fsync-sync) create "testme"
+(fsync-sync) open "testme"
+(fsync-sync) write "testme"
+(fsync-sync) fsync "testme"
+(fsync-sync) fsync unopened fd
+(fsync-sync) close "testme"
+(fsync-sync) open "synced" for verification
+(fsync-sync) verified contents of "synced"
+(fsync-sync) close "synced"
+(fsync-sync) open "testme" for verification
+(fsync-sync) verified contents of "testme"
+(fsync-sync) close "testme"
+(fsync-sync) end
+EOF
+pass;
@@ -0,0 +1,59 @@
+/* Grows a file by more sectors than the buffer cache holds,
+   through more index blocks than a journal transaction holds:
+   first with a single write far past its end, then by creating
+   it with a large initial size.  Each time, checks that the file
+   reads back as zeros, except for the byte written. */
+
+#include <syscall.h>
+#include "tests/lib.h"
+#include "tests/main.h"
+
+/* 9,216 sectors, which take 73 index blocks. */
+#define FILE_SIZE (4608 * 1024)
+
+static char buf[4096];
+
+static void
+check_zeros (const char *file_name, char last)
+{
+  int fd;
+  int ofs;
+
+  CHECK ((fd = open (file_name)) > 1,
+         "open \"%s\" for verification", file_name);
+  CHECK (filesize (fd) == FILE_SIZE, "\"%s\" is %d bytes long",
+         file_name, FILE_SIZE);
+  for (ofs = 0; ofs < FILE_SIZE; ofs += sizeof buf)
+    {
+      size_t i;
+
+      if (read (fd, buf, sizeof buf) != sizeof buf)
+        fail ("read of \"%s\" at offset %d failed", file_name, ofs);
+      for (i = 0; i < sizeof buf; i++)
+        if (buf[i] != (ofs + i == FILE_SIZE - 1 ? last : 0))
+          fail ("byte %zu of \"%s\" is %d", ofs + i, file_name, buf[i]);
+    }
+  msg ("verified contents of \"%s\"", file_name);
+  msg ("close \"%s\"", file_name);
+  close (fd);
+}
+
+void
+test_main (void) 
+{
+  int fd;
+
+  CHECK (create ("sparse", 0), "create \"sparse\"");
+  CHECK ((fd = open ("sparse")) > 1, "open \"sparse\"");
+  msg ("seek \"sparse\"");
+  seek (fd, FILE_SIZE - 1);
+  CHECK (write (fd, "x", 1) == 1, "write \"sparse\"");
+  msg ("close \"sparse\"");
+  close (fd);
+  check_zeros ("sparse", 'x');
+  CHECK (remove ("sparse"), "remove \"sparse\"");
+
+  CHECK (create ("prealloc", FILE_SIZE), "create \"prealloc\"");
+  check_zeros ("prealloc", 0);
+  CHECK (remove ("prealloc"), "remove \"prealloc\"");
+}
@@ -0,0 +1,25 @@
+# -*- perl -*-
+use strict;
+use warnings;
+use tests::tests;
+check_expected (IGNORE_EXIT_CODES => 1, [<<'EOF']);
+(grow-huge) begin
+(grow-huge) create "sparse"
+(grow-huge) open "sparse"
+(grow-huge) seek "sparse"
+(grow-huge) write "sparse"
+(grow-huge) close "sparse"
+(grow-huge) open "sparse" for verification
+(grow-huge) "sparse" is 4718592 bytes long
+(grow-huge) verified contents of "sparse"
+(grow-huge) close "sparse"
+(grow-huge) remove "sparse"
+(grow-huge) create "prealloc"
+(grow-huge) open "prealloc" for verification
+(grow-huge) "prealloc" is 4718592 bytes long
+(grow-huge) verified contents of "prealloc"
+(grow-huge) close "prealloc"
+(grow-huge) remove "prealloc"
+(grow-huge) end
+EOF
+pass;
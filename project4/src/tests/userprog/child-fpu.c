@@ -0,0 +1,18 @@
+/* Child process run by fpu-interleave.  Does its own x87
+   arithmetic while the parent does the same, and exits with
+   status 0 if its result came out right. */
+
+#include <stdio.h>
+#include "tests/lib.h"
+#include "tests/userprog/fpu-sum.h"
+
+const char *test_name = "child-fpu";
+
+int
+main (void) 
+{
+  long long sum = fpu_sum (2, 5);
+
+  msg ("sum is %lld", sum);
+  return sum == 2 + 5 * FPU_SUM_CNT ? 0 : 1;
+}
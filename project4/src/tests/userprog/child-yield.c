@@ -0,0 +1,16 @@
+/* Child process run by switch-pingpong.  Yields the CPU back to
+   its parent the same number of times as the parent yields to
+   it. */
+
+#include <syscall.h>
+#include "tests/userprog/pingpong.h"
+
+int
+main (void) 
+{
+  int i;
+
+  for (i = 0; i < PINGPONG_CNT; i++)
+    yield ();
+  return 0;
+}
@@ -0,0 +1,22 @@
+/* Runs a child process that does x87 arithmetic in lockstep
+   with this one, each yielding to the other after every step,
+   and checks that neither disturbed the other's FPU state. */
+
+#include <syscall.h>
+#include "tests/lib.h"
+#include "tests/main.h"
+#include "tests/userprog/fpu-sum.h"
+
+void
+test_main (void) 
+{
+  pid_t child = exec ("child-fpu");
+  long long sum;
+
+  CHECK (child != -1, "exec \"child-fpu\"");
+  sum = fpu_sum (1, 3);
+  CHECK (wait (child) == 0, "wait for child-fpu");
+  if (sum != 1 + 3 * FPU_SUM_CNT)
+    fail ("sum is %lld, should be %d", sum, 1 + 3 * FPU_SUM_CNT);
+  msg ("sum is %lld", sum);
+}
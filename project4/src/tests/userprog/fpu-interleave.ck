@@ -0,0 +1,15 @@
+# -*- perl -*-
+use strict;
+use warnings;
+use tests::tests;
+check_expected ([<<'EOF']);
+(fpu-interleave) begin
+(fpu-interleave) exec "child-fpu"
+(child-fpu) sum is 5002
+child-fpu: exit(0)
+(fpu-interleave) wait for child-fpu
+(fpu-interleave) sum is 3001
+(fpu-interleave) end
+fpu-interleave: exit(0)
+EOF
+pass;
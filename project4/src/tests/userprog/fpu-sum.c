@@ -0,0 +1,33 @@
+/* Adds STEP to START FPU_SUM_CNT times on the x87 FPU and
+   returns the result.  The running sum stays in an FPU register
+   throughout, and the process yields after every addition, so
+   another process that uses the FPU between additions can only
+   leave the sum intact if the kernel saves and restores FPU
+   state across the switch.  User programs are compiled with
+   -msoft-float, so this is done in assembly. */
+
+#include "tests/userprog/fpu-sum.h"
+#include <syscall-nr.h>
+
+long long
+fpu_sum (int start, int step) 
+{
+  long long sum;
+  int cnt = FPU_SUM_CNT;
+
+  asm volatile ("fildl %[step]\n\t"     /* st(0) = step. */
+                "fildl %[start]\n"     /* st(0) = start, st(1) = step. */
+                "1:\tfadd %%st(1), %%st\n\t"
+                "pushl %[nr]\n\t"      /* yield (). */
+                "int $0x30\n\t"
+                "addl $4, %%esp\n\t"
+                "decl %[cnt]\n\t"
+                "jnz 1b\n\t"
+                "fistpll %[sum]\n\t"
+                "fstp %%st(0)"
+                : [sum] "=m" (sum), [cnt] "+r" (cnt)
+                : [start] "m" (start), [step] "m" (step),
+                  [nr] "i" (SYS_YIELD)
+                : "eax", "memory");
+  return sum;
+}
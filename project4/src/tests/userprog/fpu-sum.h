@@ -0,0 +1,9 @@
+#ifndef TESTS_USERPROG_FPU_SUM_H
+#define TESTS_USERPROG_FPU_SUM_H
+
+/* Number of additions each process makes in fpu_sum(). */
+#define FPU_SUM_CNT 1000
+
+long long fpu_sum (int start, int step);
+
+#endif /* tests/userprog/fpu-sum.h */
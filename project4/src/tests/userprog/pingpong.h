@@ -0,0 +1,8 @@
+#ifndef TESTS_USERPROG_PINGPONG_H
+#define TESTS_USERPROG_PINGPONG_H
+
+/* Number of times each of switch-pingpong and child-yield
+   yields the CPU. */
+#define PINGPONG_CNT 10000
+
+#endif /* tests/userprog/pingpong.h */
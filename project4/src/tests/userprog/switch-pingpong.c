@@ -0,0 +1,35 @@
+/* Measures the cost of switching between two processes.  This
+   process and child-yield yield the CPU back and forth, so each
+   yield here is a round trip of two switches.  The average, in
+   time-stamp counter cycles, varies from run to run, so the
+   check only looks for it to be reported. */
+
+#include <syscall.h>
+#include "tests/lib.h"
+#include "tests/main.h"
+#include "tests/userprog/pingpong.h"
+
+/* Returns the CPU's time-stamp counter. */
+static unsigned long long
+read_tsc (void) 
+{
+  unsigned long long tsc;
+  asm volatile ("rdtsc" : "=A" (tsc));
+  return tsc;
+}
+
+void
+test_main (void) 
+{
+  unsigned long long start, cycles;
+  pid_t child;
+  int i;
+
+  CHECK ((child = exec ("child-yield")) != -1, "exec \"child-yield\"");
+  start = read_tsc ();
+  for (i = 0; i < PINGPONG_CNT; i++)
+    yield ();
+  cycles = read_tsc () - start;
+  CHECK (wait (child) == 0, "wait for child-yield");
+  msg ("%llu cycles per switch", cycles / (2 * PINGPONG_CNT));
+}
@@ -0,0 +1,17 @@
+# -*- perl -*-
+use strict;
+use warnings;
+use tests::tests;
+
+our ($test);
+my (@output) = read_text_file ("$test.output");
+
+common_checks ("run", @output);
+
+@output = get_core_output ("run", @output);
+fail "child-yield did not exit cleanly"
+  unless grep ($_ eq 'child-yield: exit(0)', @output);
+fail "missing switch cost in output"
+  unless grep (/^\(switch-pingpong\) \d+ cycles per switch$/, @output);
+
+pass;
@@ -25,6 +25,7 @@
 #ifdef USERPROG
 #include "userprog/process.h"
 #include "userprog/exception.h"
+#include "userprog/fpu.h"
 #include "userprog/gdt.h"
 #include "userprog/syscall.h"
 #include "userprog/tss.h"
@@ -34,6 +35,7 @@
 #ifdef FILESYS
 #include "devices/block.h"
 #include "devices/ide.h"
+#include "devices/ramdisk.h"
 #include "filesys/filesys.h"
 #include "filesys/fsutil.h"
 #endif
@@ -52,6 +54,10 @@ static const char *scratch_bdev_name;
 #ifdef VM
 static const char *swap_bdev_name;
 #endif
+
+/* -ramdisk: Size in kB of RAM disk to create, or 0 for none. */
+static size_t ramdisk_size_kb;
+static struct block *ramdisk;
 #endif /* FILESYS */
 
 /* -ul: Maximum number of pages to put into palloc's user pool. */
@@ -113,6 +119,7 @@ main (void)
 #ifdef USERPROG
   exception_init ();
   syscall_init ();
+  fpu_init ();
 #endif
 
   /* Start thread scheduler and enable interrupts. */
@@ -123,7 +130,14 @@ main (void)
 #ifdef FILESYS
   /* Initialize file system. */
   ide_init ();
+  if (ramdisk_size_kb > 0)
+    ramdisk = ramdisk_init (ramdisk_size_kb);
   locate_block_devices ();
+
+  /* A RAM disk starts out empty, so a file system on it must be
+     created at each boot. */
+  if (ramdisk != NULL && block_get_role (BLOCK_FILESYS) == ramdisk)
+    format_filesys = true;
   filesys_init (format_filesys);
 #endif
 
@@ -247,6 +261,21 @@ parse_options (char **argv)
         filesys_bdev_name = value;
       else if (!strcmp (name, "-scratch"))
         scratch_bdev_name = value;
+      else if (!strcmp (name, "-ramdisk"))
+        {
+          if (value == NULL)
+            PANIC ("-ramdisk requires a size (use -ramdisk=KB)");
+          ramdisk_size_kb = atoi (value);
+        }
+      else if (!strcmp (name, "-iotrace"))
+        block_trace_dump = true;
+      else if (!strcmp (name, "-noflush"))
+        filesys_no_flush = true;
+      else if (!strcmp (name, "-iosched"))
+        {
+          if (value == NULL || !block_set_iosched (value))
+            PANIC ("unknown I/O scheduler `%s'", value != NULL ? value : "");
+        }
 #ifdef VM
       else if (!strcmp (name, "-swap"))
         swap_bdev_name = value;
@@ -373,6 +402,10 @@ usage (void)
           "  -f                 Format file system device during startup.\n"
           "  -filesys=BDEV      Use BDEV for file system instead of default.\n"
           "  -scratch=BDEV      Use BDEV for scratch instead of default.\n"
+          "  -ramdisk=KB        Create RAM disk ram0 of KB kB.\n"
+          "  -iosched=NAME      Schedule disk I/O with NAME: deadline, fifo.\n"
+          "  -iotrace           Print recent disk requests at shutdown.\n"
+          "  -noflush           Don't write back file system at shutdown.\n"
 #ifdef VM
           "  -swap=BDEV         Use BDEV for swap instead of default.\n"
 #endif
@@ -124,7 +124,7 @@ thread_init (void)
   init_thread (initial_thread, "main", PRI_DEFAULT);
   initial_thread->status = THREAD_RUNNING;
   initial_thread->tid = allocate_tid ();
-  initial_thread->cwd_sector = ROOT_DIR_SECTOR;
+  initial_thread->cwd = NULL;
 }
 
 /* Starts preemptive thread scheduling by enabling interrupts.
@@ -211,8 +211,9 @@ thread_create (const char *name, int priority,
   init_thread (t, name, priority);
   tid = t->tid = allocate_tid ();
   t->parent_id = thread_current ()->tid;
-  t->cwd_sector = thread_current()->cwd_sector;
-  //t->cwd_name = thread_current ()->cwd_name;
+#ifdef FILESYS
+  t->cwd = dir_reopen (thread_current ()->cwd);
+#endif
 
   /* Prepare thread for first run by initializing its stack.
      Do this atomically so intermediate values for the 'stack' 
@@ -323,6 +324,10 @@ thread_exit (void)
 #ifdef USERPROG
   process_exit ();
 #endif
+#ifdef FILESYS
+  dir_close (thread_current ()->cwd);
+  thread_current ()->cwd = NULL;
+#endif
 
   /* Remove thread from all threads list, set our status to dying,
      and schedule another process.  That process will destroy us
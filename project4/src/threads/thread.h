@@ -8,6 +8,9 @@
 #include "threads/synch.h"
 #include "filesys/directory.h"
 #include "devices/block.h"
+#ifdef USERPROG
+#include "userprog/fpu.h"
+#endif
 
 /* States in a thread's life cycle. */
 enum thread_status
@@ -100,6 +103,10 @@ struct thread
 #ifdef USERPROG
     /* Owned by userprog/process.c. */
     uint32_t *pagedir;                  /* Page directory. */
+
+    /* Owned by userprog/fpu.c. */
+    uint8_t fpu_state[FPU_STATE_SIZE]; /* FPU state, FNSAVE format. */
+    bool fpu_used;                      /* Has ever used the FPU? */
 #endif
 
     /* Owned by thread.c. */
@@ -128,8 +135,14 @@ struct thread
        process terminates before releasing all the locks */
     struct list acquired_locks;
 
-    /* this thread's current working directory's sector */
-    block_sector_t cwd_sector;
+    /* this thread's current working directory, kept open so that
+       relative paths and "." resolve without a lookup.  Null
+       until the file system is initialized. */
+    struct dir *cwd;
+
+    /* Nesting depth of file system operations, owned by
+       filesys/journal.c. */
+    int journal_depth;
   };
 
 
@@ -0,0 +1,107 @@
+#include "userprog/fpu.h"
+#include <debug.h>
+#include <stdint.h>
+#include "threads/interrupt.h"
+#include "threads/thread.h"
+
+/* Floating-point unit state, switched lazily.
+
+   The kernel is built with -msoft-float, so only user programs
+   touch the FPU.  Rather than saving and restoring its state on
+   every thread switch, we leave it loaded with the state of the
+   last thread to use it, its "owner", and set CR0.TS whenever
+   some other thread runs.  The first FPU instruction that thread
+   executes then raises #NM, whose handler saves the owner's
+   state, loads the thread's own and makes it the owner.  Threads
+   that never use the FPU never pay for it. */
+
+/* CR0 bits. */
+#define CR0_MP 0x00000002       /* Monitor coprocessor. */
+#define CR0_EM 0x00000004       /* (Floating-point) Emulation. */
+#define CR0_TS 0x00000008       /* Task switched. */
+#define CR0_NE 0x00000020       /* Numeric error reporting via #MF. */
+
+/* Thread whose state the FPU holds, or a null pointer. */
+static struct thread *fpu_owner;
+
+static intr_handler_func fpu_trap;
+
+static uint32_t
+read_cr0 (void)
+{
+  uint32_t cr0;
+  asm volatile ("movl %%cr0, %0" : "=r" (cr0));
+  return cr0;
+}
+
+static void
+write_cr0 (uint32_t cr0)
+{
+  asm volatile ("movl %0, %%cr0" : : "r" (cr0));
+}
+
+/* Turns off the floating-point emulation that start.S turned
+   on, initializes the FPU and registers the #NM handler. */
+void
+fpu_init (void)
+{
+  write_cr0 ((read_cr0 () & ~(CR0_EM | CR0_TS)) | CR0_MP | CR0_NE);
+  asm volatile ("fninit");
+  write_cr0 (read_cr0 () | CR0_TS);
+
+  intr_register_int (7, 0, INTR_OFF, fpu_trap,
+                     "#NM Device Not Available Exception");
+}
+
+/* Lets the current thread use the FPU without trapping if it
+   owns it, and makes it trap otherwise.  Called on every thread
+   switch, so CR0 is only written when TS has to change. */
+void
+fpu_activate (void)
+{
+  uint32_t cr0 = read_cr0 ();
+  uint32_t new_cr0;
+
+  if (thread_current () == fpu_owner)
+    new_cr0 = cr0 & ~CR0_TS;
+  else
+    new_cr0 = cr0 | CR0_TS;
+  if (new_cr0 != cr0)
+    write_cr0 (new_cr0);
+}
+
+/* Forgets the FPU state of T, which is exiting. */
+void
+fpu_release (struct thread *t)
+{
+  enum intr_level old_level = intr_disable ();
+  if (fpu_owner == t)
+    {
+      fpu_owner = NULL;
+      write_cr0 (read_cr0 () | CR0_TS);
+    }
+  intr_set_level (old_level);
+}
+
+/* #NM handler: the current thread used the FPU while TS was
+   set.  Switches the FPU over to it. */
+static void
+fpu_trap (struct intr_frame *f UNUSED)
+{
+  struct thread *cur = thread_current ();
+
+  asm volatile ("clts");
+  if (fpu_owner == cur)
+    return;
+
+  if (fpu_owner != NULL)
+    asm volatile ("fnsave %0" : "=m" (fpu_owner->fpu_state));
+  if (cur->fpu_used)
+    asm volatile ("frstor %0" : : "m" (cur->fpu_state));
+  else
+    {
+      asm volatile ("fninit");
+      cur->fpu_used = true;
+    }
+  fpu_owner = cur;
+}
@@ -0,0 +1,13 @@
+#ifndef USERPROG_FPU_H
+#define USERPROG_FPU_H
+
+/* Size of the FPU state saved by FNSAVE, in bytes. */
+#define FPU_STATE_SIZE 108
+
+struct thread;
+
+void fpu_init (void);
+void fpu_activate (void);
+void fpu_release (struct thread *);
+
+#endif /* userprog/fpu.h */
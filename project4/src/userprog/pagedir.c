@@ -230,6 +230,16 @@ pagedir_activate (uint32_t *pd)
   asm volatile ("movl %0, %%cr3" : : "r" (vtop (pd)) : "memory");
 }
 
+/* Returns true if PD, or the kernel-only page directory if PD
+   is a null pointer, is the active page directory. */
+bool
+pagedir_is_active (uint32_t *pd) 
+{
+  if (pd == NULL)
+    pd = init_page_dir;
+  return active_pd () == pd;
+}
+
 /* Returns the currently active page directory. */
 static uint32_t *
 active_pd (void) 
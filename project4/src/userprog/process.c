@@ -5,6 +5,7 @@
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
+#include "userprog/fpu.h"
 #include "userprog/gdt.h"
 #include "userprog/pagedir.h"
 #include "userprog/tss.h"
@@ -272,6 +273,8 @@ process_exit (void)
       pagedir_activate (NULL);
       pagedir_destroy (pd);
     }
+
+  fpu_release (cur);
 }
 
 /* Sets up the CPU for running user code in the current
@@ -282,12 +285,18 @@ process_activate (void)
 {
   struct thread *t = thread_current ();
 
-  /* Activate thread's page tables. */
-  pagedir_activate (t->pagedir);
+  /* Activate thread's page tables.  Reloading CR3 flushes the
+     TLB, so skip it when switching between kernel threads or
+     threads that share page tables. */
+  if (!pagedir_is_active (t->pagedir))
+    pagedir_activate (t->pagedir);
 
   /* Set thread's kernel stack for use in processing
      interrupts. */
   tss_update ();
+
+  /* Make the FPU trap unless it already holds our state. */
+  fpu_activate ();
 }
 
 /* We load ELF binaries.  The following definitions are taken
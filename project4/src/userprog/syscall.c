@@ -36,6 +36,10 @@ static void syscall_mkdir (struct intr_frame *f, void *cur_sp);
 static void syscall_readdir (struct intr_frame *f, void *cur_sp);
 static void syscall_isdir (struct intr_frame *f, void *cur_sp);
 static void syscall_inumber (struct intr_frame *f, void *cur_sp);
+static void syscall_readdir_batch (struct intr_frame *f, void *cur_sp);
+static void syscall_fsync (struct intr_frame *f, void *cur_sp);
+static void syscall_sync (struct intr_frame *f, void *cur_sp);
+static void syscall_yield (struct intr_frame *f, void *cur_sp);
 
 /* pointer validity */
 static bool syscall_invalid_ptr (const void *ptr);
@@ -205,6 +209,18 @@ syscall_handler (struct intr_frame *f)
       case SYS_INUMBER:
         syscall_inumber (f, cur_sp);
         break;
+      case SYS_READDIR_BATCH:
+        syscall_readdir_batch (f, cur_sp);
+        break;
+      case SYS_FSYNC:
+        syscall_fsync (f, cur_sp);
+        break;
+      case SYS_SYNC:
+        syscall_sync (f, cur_sp);
+        break;
+      case SYS_YIELD:
+        syscall_yield (f, cur_sp);
+        break;
       default :
         printf ("Invalid system call! #%d\n", syscall_num);
         syscall_thread_exit (f, -1);
@@ -622,4 +638,55 @@ syscall_inumber (struct intr_frame *f, void *cur_sp)
   return;
 }
 
+static void
+syscall_readdir_batch (struct intr_frame *f, void *cur_sp)
+{
+  int fd;
+  void *buffer;
+  unsigned size;
+  VALIDATE_AND_GET_ARG (cur_sp, fd, f);
+  cur_sp += sizeof (int);
+  VALIDATE_AND_GET_ARG (cur_sp, buffer, f);
+  cur_sp += sizeof (void *);
+  VALIDATE_AND_GET_ARG (cur_sp, size, f);
+
+  /* terminate process if any page that is occupied by the 
+     buffer is invalid */
+  if (syscall_invalid_ptr (buffer) || syscall_invalid_ptr (buffer + size))
+    {
+      syscall_thread_exit (f, -1);
+      return;
+    }
+  void *buffer_tmp_ptr = buffer + PGSIZE;
+  while (buffer_tmp_ptr < buffer + size)
+    {
+      if (syscall_invalid_ptr (buffer_tmp_ptr))
+	{
+	  syscall_thread_exit (f, -1);
+	  return;
+	}
+      buffer_tmp_ptr += PGSIZE;
+    }
+
+  f->eax = filesys_readdir_batch (fd, buffer, size);
+}
+
+static void
+syscall_fsync (struct intr_frame *f, void *cur_sp)
+{
+  int fd;
+  VALIDATE_AND_GET_ARG (cur_sp, fd, f);
+  f->eax = filesys_fsync (fd);
+}
+
+static void
+syscall_sync (struct intr_frame *f UNUSED, void *cur_sp UNUSED)
+{
+  filesys_sync ();
+}
 
+static void
+syscall_yield (struct intr_frame *f UNUSED, void *cur_sp UNUSED)
+{
+  thread_yield ();
+}